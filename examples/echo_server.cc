@@ -2,6 +2,7 @@
 #include "bytearray.h"
 #include "log.h"
 #include "hook.h"
+#include "config.h"
 
 static orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
 
@@ -15,6 +16,10 @@ public:
 
     void handleClient(orange::Socket::ptr sock) override {
         ORANGE_LOG_INFO(g_logger) << "handleClent...";
+        if(m_type == 3) {
+            echo(sock);
+            return;
+        }
         orange::ByteArray::ptr ba(new orange::ByteArray());
         while(true) {
             std::vector<iovec> iovs;
@@ -39,6 +44,26 @@ public:
             }
         }
     }
+private:
+    // 原样写回，不打印，用于压测
+    void echo(orange::Socket::ptr sock) {
+        char buf[4096];
+        while(true) {
+            int rt = sock->recv(buf, sizeof(buf));
+            if(rt <= 0) {
+                break;
+            }
+            int offset = 0;
+            while(offset < rt) {
+                int n = sock->send(buf + offset, rt - offset);
+                if(n <= 0) {
+                    return;
+                }
+                offset += n;
+            }
+        }
+    }
+
 private:
     int m_type = 0;
 };
@@ -56,14 +81,21 @@ void run() {
 
 int main(int argc, char** argv) {
     if(argc < 2) {
-        ORANGE_LOG_ERROR(g_logger) << "use as[" << argv[0] << " -t or -b" << "]";
+        ORANGE_LOG_ERROR(g_logger) << "use as[" << argv[0] << " -t or -b or -e [epoll|io_uring]" << "]";
         return 0;
     }
     if(strcmp(argv[1], "-t") == 0) {
         type = 1;
+    } else if(strcmp(argv[1], "-e") == 0) {
+        type = 3;
+        g_logger->setLevel(orange::LogLevel::ERROR);
+        ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
     } else {
         type = 2;
     }
+    if(argc > 2) {
+        orange::Config::Lookup<std::string>("iomanager.backend")->setValue(argv[2]);
+    }
 
     orange::IOManager iom(2);
     iom.schedule(run);
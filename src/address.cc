@@ -7,6 +7,7 @@
 
 #include <sstream>
 
+#include "dns.h"
 #include "endian.hpp"
 #include "log.h"
 
@@ -28,6 +29,28 @@ static int32_t CountBytes(T value) {
     return result;
 }
 
+// 不是数字地址
+static bool IsHostName(const std::string& node) {
+    uint8_t buf[16];
+    return !node.empty() && inet_pton(AF_INET, node.c_str(), buf) != 1
+        && inet_pton(AF_INET6, node.c_str(), buf) != 1;
+}
+
+// 没有端口或者是数字端口
+static bool ParsePort(const char* service, uint16_t& port) {
+    port = 0;
+    if(!service || !*service) {
+        return true;
+    }
+    char* end = nullptr;
+    long v = strtol(service, &end, 10);
+    if(*end || v < 0 || v > 65535) {
+        return false;
+    }
+    port = (uint16_t)v;
+    return true;
+}
+
 // Address
 bool Address::Lookup(std::vector<Address::ptr>& result, const std::string& host,
                 int family, int type, int protocol) {
@@ -66,6 +89,23 @@ bool Address::Lookup(std::vector<Address::ptr>& result, const std::string& host,
         node = host;
     }
 
+    // 域名交给协程化的DNS解析，数字地址、非数字端口和其他协议族仍然用getaddrinfo
+    uint16_t port = 0;
+    if(DnsResolver::IsEnabled() && IsHostName(node) && ParsePort(service, port)
+            && (family == AF_INET || family == AF_INET6 || family == AF_UNSPEC)) {
+        std::vector<IPAddress::ptr> addrs;
+        if(!DnsMgr::GetInstance()->resolve(node, family, addrs)) {
+            ORANGE_LOG_ERROR(g_logger) << "IPAddress::Lookup resolve(" << host << ", "
+                                       << family << ") fail";
+            return false;
+        }
+        for(auto& i : addrs) {
+            i->setPort(port);
+            result.push_back(i);
+        }
+        return true;
+    }
+
     int error = getaddrinfo(node.c_str(), service, &hints, &results);
     if(error) {
         ORANGE_LOG_ERROR(g_logger) << "IPAddress::Lookup getaddrinfo(" << host << ", "
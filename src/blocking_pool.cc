@@ -0,0 +1,152 @@
+#include "blocking_pool.h"
+
+#include <atomic>
+
+#include "config.h"
+#include "hook.h"
+#include "log.h"
+#include "scheduler.h"
+
+namespace orange {
+
+static orange::Logger::ptr g_logger = ORANGE_LOG_NAME("system");
+
+static orange::ConfigVar<uint32_t>::ptr g_blocking_pool_threads =
+    orange::Config::Lookup<uint32_t>("blocking_pool.threads", 0
+            , "threads for offloading blocking file io, 0 for off");
+
+// 日志在静态初始化、析构期间也会用到线程池，只用不需要构造的静态变量判断
+static std::atomic<uint32_t> s_threads = {0};
+static std::atomic<bool> s_stopped = {false};
+
+struct _BlockingPoolIniter {
+    _BlockingPoolIniter() {
+        s_threads = g_blocking_pool_threads->getValue();
+        g_blocking_pool_threads->addListener([](const uint32_t& old_value, const uint32_t& new_value) {
+            s_threads = new_value;
+        });
+    }
+};
+
+static _BlockingPoolIniter s_blocking_pool_initer;
+
+BlockingPool::BlockingPool() {
+}
+
+BlockingPool::~BlockingPool() {
+    {
+        MutexType::Lock lock(m_mutex);
+        m_stopping = true;
+    }
+    s_stopped = true;
+    // 剩下的任务处理完才退出
+    for(size_t i = 0; i < m_threads.size(); ++i) {
+        m_semaphore.notify();
+    }
+    for(auto& i : m_threads) {
+        i->join();
+    }
+}
+
+bool BlockingPool::IsEnabled() {
+    return s_threads > 0 && !s_stopped;
+}
+
+bool BlockingPool::CanOffload() {
+    // hook只在调度线程上开启，调度协程自己不能挂起
+    if(!IsEnabled() || !is_hook_enable() || !Scheduler::GetThis()) {
+        return false;
+    }
+    Fiber::ptr cur = Fiber::GetThis();
+    return cur.get() != Scheduler::GetMainFiber() && !cur->isSharedStack();
+}
+
+void BlockingPool::run(const std::function<void()>& cb) {
+    if(!CanOffload()) {
+        cb();
+        return;
+    }
+    // 协程挂起期间任务一直在它的栈上
+    Task task;
+    task.cb = &cb;
+    task.scheduler = Scheduler::GetThis();
+    task.fiber = Fiber::GetThis();
+    submit(&task);
+    Fiber::YielToHold();
+    if(task.error) {
+        std::rethrow_exception(task.error);
+    }
+}
+
+void BlockingPool::post(std::function<void()> cb) {
+    if(!IsEnabled()) {
+        cb();
+        return;
+    }
+    Task* task = new Task;
+    task->own = std::move(cb);
+    task->cb = &task->own;
+    submit(task);
+}
+
+void BlockingPool::submit(Task* task) {
+    {
+        MutexType::Lock lock(m_mutex);
+        // 线程按需启动，调小线程数不会退出已有线程
+        while(m_threads.size() < s_threads) {
+            m_threads.push_back(Thread::ptr(new Thread(std::bind(&BlockingPool::work, this)
+                    , "blocking_" + std::to_string(m_threads.size()))));
+        }
+        task->next = nullptr;
+        if(m_tail) {
+            m_tail->next = task;
+        } else {
+            m_head = task;
+        }
+        m_tail = task;
+    }
+    m_semaphore.notify();
+}
+
+void BlockingPool::work() {
+    while(true) {
+        m_semaphore.wait();
+        Task* task = nullptr;
+        {
+            MutexType::Lock lock(m_mutex);
+            task = m_head;
+            if(task) {
+                m_head = task->next;
+                if(!m_head) {
+                    m_tail = nullptr;
+                }
+            } else if(m_stopping) {
+                break;
+            }
+        }
+        if(!task) {
+            continue;
+        }
+
+        try {
+            (*task->cb)();
+        } catch(...) {
+            task->error = std::current_exception();
+        }
+
+        if(task->fiber) {
+            // 放回调度器之后协程可能马上恢复并返回，不能再访问task
+            Scheduler* scheduler = task->scheduler;
+            Fiber::ptr fiber;
+            fiber.swap(task->fiber);
+            scheduler->schedule(fiber);
+        } else {
+            if(task->error) {
+                ORANGE_LOG_ERROR(g_logger) << "BlockingPool post task throw exception";
+            }
+            delete task;
+        }
+    }
+}
+
+} // namespace orange
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <vector>
+
+#include "fiber.h"
+#include "mutex.h"
+#include "noncopyable.h"
+#include "singleton.h"
+#include "thread.h"
+
+namespace orange {
+
+class Scheduler;
+
+/*
+* 阻塞调用(普通文件读写、open、fsync等)的卸载线程池
+* 协程挂起，由池里的线程执行阻塞调用，完成后把协程放回原来的调度器，工作线程可以继续跑其他协程
+* 线程数由blocking_pool.threads配置，0为关闭(默认)，此时所有调用都在当前线程直接执行
+*/
+class BlockingPool : Noncopyable {
+public:
+    typedef Mutex MutexType;
+
+    BlockingPool();
+    ~BlockingPool();
+
+    /*
+    * 执行cb并等待完成。在调度器协程里时挂起当前协程，由池里的线程执行
+    * 池没有开启、不在协程里或者当前是共享栈协程(挂起后栈被换出)时直接执行
+    * cb抛出的异常在当前协程里重新抛出
+    */
+    void run(const std::function<void()>& cb);
+    // 不等待，交给池里的线程异步执行。池没有开启时直接执行
+    void post(std::function<void()> cb);
+
+    static bool IsEnabled();
+    // 当前调用run()是否会挂起协程
+    static bool CanOffload();
+
+private:
+    struct Task {
+        const std::function<void()>* cb = nullptr;
+        // post的任务持有回调，执行后释放
+        std::function<void()> own;
+        Scheduler* scheduler = nullptr;
+        Fiber::ptr fiber;
+        std::exception_ptr error;
+        Task* next = nullptr;
+    };
+
+    void submit(Task* task);
+    void work();
+
+private:
+    MutexType m_mutex;
+    Semaphore m_semaphore;
+    Task* m_head = nullptr;
+    Task* m_tail = nullptr;
+    std::vector<Thread::ptr> m_threads;
+    bool m_stopping = false;
+};
+
+typedef orange::Singleton<BlockingPool> BlockingPoolMgr;
+
+} // namespace orange
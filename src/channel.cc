@@ -0,0 +1,140 @@
+#include "channel.h"
+
+#include <algorithm>
+
+namespace orange {
+
+ChannelBase::ChannelBase() {
+    m_waiting[SEND] = 0;
+    m_waiting[RECV] = 0;
+}
+
+void ChannelBase::fireSelects(Side side, std::vector<SelectWaiter::ptr>& fired) {
+    for(auto& i : m_selects[side]) {
+        // 每个select只唤醒一次，它醒来后自己从各个通道上撤销
+        if(!i->fired.exchange(true)) {
+            fired.push_back(i);
+        }
+    }
+}
+
+void ChannelBase::notify(Side side, MutexType::Lock& lock) {
+    FiberWaiter waiter;
+    bool has = m_waiters[side].pop(waiter);
+    if(has) {
+        m_waiting[side].fetch_sub(1);
+    }
+    std::vector<SelectWaiter::ptr> fired;
+    if(!m_selects[side].empty()) {
+        fireSelects(side, fired);
+    }
+    lock.unlock();
+    if(has) {
+        waiter.wake();
+    }
+    for(auto& i : fired) {
+        i->waiter.wake();
+    }
+}
+
+void ChannelBase::notifyAll(MutexType::Lock& lock) {
+    std::deque<FiberWaiter> waiters[2];
+    std::vector<SelectWaiter::ptr> fired;
+    for(int side = SEND; side <= RECV; ++side) {
+        m_waiters[side].popAll(waiters[side]);
+        m_waiting[side].fetch_sub(waiters[side].size());
+        fireSelects((Side)side, fired);
+    }
+    lock.unlock();
+    for(auto& i : waiters) {
+        for(auto& w : i) {
+            w.wake();
+        }
+    }
+    for(auto& i : fired) {
+        i->waiter.wake();
+    }
+}
+
+void ChannelBase::notifyIfWaiting(Side side) {
+    // 和waitUnless配对：对方先登记再检查，这边先修改再检查登记
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_waiting[side].load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    MutexType::Lock lock(m_mutex);
+    notify(side, lock);
+}
+
+void ChannelBase::addSelect(Side side, SelectWaiter::ptr waiter) {
+    MutexType::Lock lock(m_mutex);
+    m_selects[side].push_back(std::move(waiter));
+    m_waiting[side].fetch_add(1);
+}
+
+void ChannelBase::delSelect(Side side, const SelectWaiter::ptr& waiter) {
+    MutexType::Lock lock(m_mutex);
+    auto& selects = m_selects[side];
+    auto it = std::find(selects.begin(), selects.end(), waiter);
+    if(it == selects.end()) {
+        return;
+    }
+    std::swap(*it, selects.back());
+    selects.pop_back();
+    m_waiting[side].fetch_sub(1);
+}
+
+int Select::addCase(ChannelBase* chan, ChannelBase::Side side, std::function<bool()> attempt) {
+    m_cases.push_back({chan, side, std::move(attempt)});
+    return m_cases.size() - 1;
+}
+
+int Select::tryWait() {
+    size_t n = m_cases.size();
+    for(size_t k = 0; k < n; ++k) {
+        size_t i = (m_start + k) % n;
+        if(m_cases[i].attempt()) {
+            m_start = i + 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+int Select::wait() {
+    if(m_cases.empty()) {
+        return -1;
+    }
+    while(true) {
+        int idx = tryWait();
+        if(idx >= 0) {
+            return idx;
+        }
+
+        Semaphore sem;
+        ChannelBase::SelectWaiter::ptr waiter = std::make_shared<ChannelBase::SelectWaiter>();
+        bool in_fiber = waiter->waiter.init(&sem);
+        for(auto& i : m_cases) {
+            i.chan->addSelect(i.side, waiter);
+        }
+        // 登记之后再检查一次，之前的修改不会漏掉
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        idx = tryWait();
+        // 已经有分支完成时撤销等待；唤醒方抢先时仍要挂起一次，吸收它发出的调度
+        if(idx < 0 || waiter->fired.exchange(true)) {
+            if(in_fiber) {
+                Fiber::YielToHold();
+            } else {
+                sem.wait();
+            }
+        }
+        for(auto& i : m_cases) {
+            i.chan->delSelect(i.side, waiter);
+        }
+        if(idx >= 0) {
+            return idx;
+        }
+    }
+}
+
+} // namespace orange
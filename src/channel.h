@@ -0,0 +1,391 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "fiber_sync.h"
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace orange {
+
+class Select;
+
+/*
+* 协程间的通道(类似Go的channel)：满时push挂起发送方，空时pop挂起接收方
+* 收发双方可以在不同线程、不同调度器上，也可以是普通线程
+* close之后push失败，pop取完剩余的数据后失败，挂起的双方都会被唤醒
+*/
+class ChannelBase : Noncopyable {
+friend class Select;
+public:
+    typedef SpinLock MutexType;
+
+    ChannelBase();
+
+    bool isClosed() const { return m_closed.load(std::memory_order_acquire);}
+
+protected:
+    enum Side {
+        SEND = 0,
+        RECV = 1
+    };
+
+    // select在多个通道上等待，谁先就绪谁唤醒它
+    struct SelectWaiter {
+        typedef std::shared_ptr<SelectWaiter> ptr;
+        FiberWaiter waiter;
+        std::atomic<bool> fired = {false};
+    };
+
+    /*
+    * 在side上排队挂起。调用时持有lock，返回时不持有
+    * 排队后先检查ready，无锁的一方可能刚改完，已经就绪时不挂起，返回false
+    */
+    template<class Ready>
+    bool waitUnless(Side side, MutexType::Lock& lock, Ready ready) {
+        m_waiting[side].fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(ready()) {
+            m_waiting[side].fetch_sub(1);
+            lock.unlock();
+            return false;
+        }
+        m_waiters[side].wait(lock);
+        return true;
+    }
+
+    void wait(Side side, MutexType::Lock& lock) {
+        waitUnless(side, lock, []() { return false; });
+    }
+
+    // 唤醒side上的一个等待者和所有select，会释放lock
+    void notify(Side side, MutexType::Lock& lock);
+    // 唤醒两边所有的等待者，会释放lock
+    void notifyAll(MutexType::Lock& lock);
+    // 无锁的一方修改完之后调用，没有等待者时不加锁
+    void notifyIfWaiting(Side side);
+
+private:
+    void addSelect(Side side, SelectWaiter::ptr waiter);
+    void delSelect(Side side, const SelectWaiter::ptr& waiter);
+    void fireSelects(Side side, std::vector<SelectWaiter::ptr>& fired);
+
+protected:
+    MutexType m_mutex;
+    std::atomic<bool> m_closed = {false};
+
+private:
+    FiberWaitQueue m_waiters[2];
+    std::vector<SelectWaiter::ptr> m_selects[2];
+    // 等待者和select的数量，无锁的一方据此决定是否需要唤醒
+    std::atomic<uint32_t> m_waiting[2];
+};
+
+/*
+* 多生产者多消费者的通道，数据在锁内存取
+* capacity为0时不限长度，push不会挂起
+*/
+template<class T>
+class Channel : public ChannelBase {
+public:
+    typedef std::shared_ptr<Channel> ptr;
+
+    Channel(size_t capacity = 0)
+        :m_capacity(capacity) {
+    }
+
+    // 满时挂起，通道已关闭返回false
+    bool push(T v) {
+        MutexType::Lock lock(m_mutex);
+        while(!m_closed && full()) {
+            wait(SEND, lock);
+            lock.lock();
+        }
+        if(m_closed) {
+            return false;
+        }
+        m_queue.push_back(std::move(v));
+        notify(RECV, lock);
+        return true;
+    }
+
+    bool tryPush(T v) {
+        MutexType::Lock lock(m_mutex);
+        if(m_closed || full()) {
+            return false;
+        }
+        m_queue.push_back(std::move(v));
+        notify(RECV, lock);
+        return true;
+    }
+
+    // 空时挂起，通道已关闭并且取完返回false
+    bool pop(T& v) {
+        MutexType::Lock lock(m_mutex);
+        while(!m_closed && m_queue.empty()) {
+            wait(RECV, lock);
+            lock.lock();
+        }
+        if(m_queue.empty()) {
+            return false;
+        }
+        take(v);
+        notify(SEND, lock);
+        return true;
+    }
+
+    bool tryPop(T& v) {
+        MutexType::Lock lock(m_mutex);
+        if(m_queue.empty()) {
+            return false;
+        }
+        take(v);
+        notify(SEND, lock);
+        return true;
+    }
+
+    void close() {
+        MutexType::Lock lock(m_mutex);
+        if(m_closed) {
+            return;
+        }
+        m_closed = true;
+        notifyAll(lock);
+    }
+
+    size_t size() {
+        MutexType::Lock lock(m_mutex);
+        return m_queue.size();
+    }
+
+    size_t capacity() const { return m_capacity;}
+
+private:
+    bool full() const {
+        return m_capacity && m_queue.size() >= m_capacity;
+    }
+
+    void take(T& v) {
+        v = std::move(m_queue.front());
+        m_queue.pop_front();
+    }
+
+private:
+    size_t m_capacity;
+    std::deque<T> m_queue;
+};
+
+/*
+* 单生产者单消费者的有界通道，环形缓冲区无锁
+* 只有一方需要挂起或唤醒对方时才加锁
+* 同一时刻只能有一个协程(或线程)push、一个pop，select也算；close可以在任何一方调用
+*/
+template<class T>
+class SpscChannel : public ChannelBase {
+public:
+    typedef std::shared_ptr<SpscChannel> ptr;
+
+    // capacity向上取整到2的幂
+    SpscChannel(size_t capacity) {
+        size_t size = 1;
+        while(size < capacity) {
+            size <<= 1;
+        }
+        m_buffer.resize(size);
+        m_mask = size - 1;
+    }
+
+    bool push(T v) {
+        while(!isClosed()) {
+            if(put(v)) {
+                notifyIfWaiting(RECV);
+                return true;
+            }
+            MutexType::Lock lock(m_mutex);
+            waitUnless(SEND, lock, [this]() {
+                return isClosed() || !full();
+            });
+        }
+        return false;
+    }
+
+    bool tryPush(T v) {
+        if(isClosed() || !put(v)) {
+            return false;
+        }
+        notifyIfWaiting(RECV);
+        return true;
+    }
+
+    bool pop(T& v) {
+        while(true) {
+            if(take(v)) {
+                notifyIfWaiting(SEND);
+                return true;
+            }
+            if(isClosed()) {
+                // 关闭前写入的数据还要取出来
+                return tryPop(v);
+            }
+            MutexType::Lock lock(m_mutex);
+            waitUnless(RECV, lock, [this]() {
+                return isClosed() || !empty();
+            });
+        }
+    }
+
+    bool tryPop(T& v) {
+        if(!take(v)) {
+            return false;
+        }
+        notifyIfWaiting(SEND);
+        return true;
+    }
+
+    void close() {
+        // 先在m_tail上做标记，之后的put一定失败
+        m_tail.fetch_or(CLOSED);
+        if(m_closed.exchange(true)) {
+            return;
+        }
+        MutexType::Lock lock(m_mutex);
+        notifyAll(lock);
+    }
+
+    size_t size() const {
+        return tail() - m_head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return m_buffer.size();}
+
+private:
+    size_t tail() const {
+        return m_tail.load(std::memory_order_acquire) & ~CLOSED;
+    }
+
+    bool full() const {
+        return tail() - m_head.load(std::memory_order_acquire) > m_mask;
+    }
+
+    bool empty() const {
+        return tail() == m_head.load(std::memory_order_acquire);
+    }
+
+    /*
+    * 生产者调用，已关闭或者满了返回false
+    * 和close在同一个原子变量上竞争：put成功的数据一定在关闭之前，消费者取完才会看到关闭
+    */
+    bool put(T& v) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if(tail & CLOSED) {
+            return false;
+        }
+        if(tail - m_headCache > m_mask) {
+            m_headCache = m_head.load(std::memory_order_acquire);
+            if(tail - m_headCache > m_mask) {
+                return false;
+            }
+        }
+        m_buffer[tail & m_mask] = std::move(v);
+        // 只有close会同时修改m_tail，失败说明刚被关闭，这个槽位不会再被读到
+        return m_tail.compare_exchange_strong(tail, tail + 1
+                , std::memory_order_release, std::memory_order_relaxed);
+    }
+
+    // 消费者调用
+    bool take(T& v) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if(head == m_tailCache) {
+            m_tailCache = tail();
+            if(head == m_tailCache) {
+                return false;
+            }
+        }
+        v = std::move(m_buffer[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // m_tail的最高位表示已关闭
+    static const size_t CLOSED = (size_t)1 << (sizeof(size_t) * 8 - 1);
+
+    std::vector<T> m_buffer;
+    size_t m_mask;
+    // 生产者和消费者各写各的下标，分开缓存行，并缓存对方的下标
+    alignas(64) std::atomic<size_t> m_tail = {0};
+    size_t m_headCache = 0;
+    alignas(64) std::atomic<size_t> m_head = {0};
+    size_t m_tailCache = 0;
+};
+
+/*
+* 在多个通道上等待，执行最先就绪的一个分支(每次从上次之后的分支开始检查)
+* 通道关闭也算就绪，此时ok为false
+*   Select sel;
+*   int a = sel.recv(ch1, v);
+*   int b = sel.send(ch2, x, &ok);
+*   int i = sel.wait();
+*/
+class Select : Noncopyable {
+public:
+    // 添加接收分支，返回分支下标
+    template<class ChannelType, class T>
+    int recv(ChannelType& chan, T& v, bool* ok = nullptr) {
+        return addCase(&chan, ChannelBase::RECV, [&chan, &v, ok]() {
+            bool got = chan.tryPop(v);
+            if(!got) {
+                if(!chan.isClosed()) {
+                    return false;
+                }
+                got = chan.tryPop(v);
+            }
+            if(ok) {
+                *ok = got;
+            }
+            return true;
+        });
+    }
+
+    // 添加发送分支，v被复制保存
+    template<class ChannelType, class T>
+    int send(ChannelType& chan, const T& v, bool* ok = nullptr) {
+        return addCase(&chan, ChannelBase::SEND, [&chan, v, ok]() {
+            bool sent = chan.tryPush(v);
+            if(!sent && !chan.isClosed()) {
+                return false;
+            }
+            if(ok) {
+                *ok = sent;
+            }
+            return true;
+        });
+    }
+
+    // 挂起直到某个分支完成，返回它的下标，没有分支返回-1
+    int wait();
+    // 不挂起，没有就绪的分支返回-1(相当于default)
+    int tryWait();
+
+private:
+    struct Case {
+        ChannelBase* chan;
+        ChannelBase::Side side;
+        // 完成(或者通道已关闭)返回true
+        std::function<bool()> attempt;
+    };
+
+    int addCase(ChannelBase* chan, ChannelBase::Side side, std::function<bool()> attempt);
+
+private:
+    std::vector<Case> m_cases;
+    size_t m_start = 0;
+};
+
+} // namespace orange
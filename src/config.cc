@@ -6,6 +6,7 @@
 
 #include <list>
 
+#include "blocking_pool.h"
 #include "env.h"
 #include "util.h"
 
@@ -65,28 +66,40 @@ static orange::Mutex s_mutex;
 
 void Config::LoadFromConfDir(const std::string& path) {
     std::string absolute_path = orange::EnvMrg::GetInstance()->getAbsolutePath(path);
-    std::vector<std::string> files;
-    orange::FSUtil::ListAllFiles(files, absolute_path, ".yml");
-
-    for(auto& i : files) {
-        {
-            struct stat st;
-            if(lstat(i.c_str(), &st) == 0) {
-                orange::Mutex::Lock lock(s_mutex);
-                if(s_file2modifytime[i] == (uint64_t)st.st_mtime) {
-                    continue;
+    // 读目录、读文件和解析可能卡在磁盘上，交给阻塞线程池，在当前协程里应用配置
+    std::vector<std::pair<std::string, YAML::Node> > nodes;
+    BlockingPoolMgr::GetInstance()->run([&absolute_path, &nodes]() {
+        std::vector<std::string> files;
+        orange::FSUtil::ListAllFiles(files, absolute_path, ".yml");
+
+        for(auto& i : files) {
+            {
+                struct stat st;
+                if(lstat(i.c_str(), &st) == 0) {
+                    orange::Mutex::Lock lock(s_mutex);
+                    if(s_file2modifytime[i] == (uint64_t)st.st_mtime) {
+                        continue;
+                    }
+                    s_file2modifytime[i] = (uint64_t)st.st_mtime;
                 }
-                s_file2modifytime[i] = (uint64_t)st.st_mtime;
+            }
+            try {
+                nodes.push_back(std::make_pair(i, YAML::LoadFile(i)));
+            } catch(...) {
+                ORANGE_LOG_INFO(g_logger) << "LoadConfFile file="
+                        << i << " fail";
             }
         }
+    });
+
+    for(auto& i : nodes) {
         try {
-            YAML::Node root = YAML::LoadFile(i);
-            LoadFromYaml(root);
+            LoadFromYaml(i.second);
             ORANGE_LOG_INFO(g_logger) << "LoadConfFile file="
-                    << i << " ok";
+                    << i.first << " ok";
         } catch(...) {
             ORANGE_LOG_INFO(g_logger) << "LoadConfFile file="
-                    << i << " fail";
+                    << i.first << " fail";
         }
     }
 }
@@ -0,0 +1,492 @@
+#include "dns.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include "blocking_pool.h"
+#include "config.h"
+#include "log.h"
+#include "socket.h"
+#include "util.h"
+
+namespace orange {
+
+static orange::Logger::ptr g_logger = ORANGE_LOG_NAME("system");
+
+static orange::ConfigVar<bool>::ptr g_dns_enable =
+    orange::Config::Lookup<bool>("dns.enable", false
+            , "resolve hostnames in Address::Lookup with the fiber-aware dns resolver");
+
+static orange::ConfigVar<std::vector<std::string> >::ptr g_dns_servers =
+    orange::Config::Lookup<std::vector<std::string> >("dns.servers", std::vector<std::string>()
+            , "dns servers ip[:port], empty for nameservers in /etc/resolv.conf");
+
+static orange::ConfigVar<std::string>::ptr g_dns_hosts_file =
+    orange::Config::Lookup<std::string>("dns.hosts_file", "/etc/hosts"
+            , "hosts file checked before dns servers, empty for none");
+
+static orange::ConfigVar<uint32_t>::ptr g_dns_timeout_ms =
+    orange::Config::Lookup<uint32_t>("dns.timeout_ms", 1000, "dns query timeout per server");
+
+static orange::ConfigVar<uint32_t>::ptr g_dns_attempts =
+    orange::Config::Lookup<uint32_t>("dns.attempts", 2, "rounds over the dns server list");
+
+static orange::ConfigVar<uint32_t>::ptr g_dns_negative_ttl =
+    orange::Config::Lookup<uint32_t>("dns.negative_ttl", 30
+            , "seconds to cache a name that does not exist");
+
+static orange::ConfigVar<uint32_t>::ptr g_dns_cache_size =
+    orange::Config::Lookup<uint32_t>("dns.cache_size", 10000, "max dns cache entries");
+
+static const uint16_t DNS_TYPE_A = 1;
+static const uint16_t DNS_TYPE_AAAA = 28;
+static const uint16_t DNS_CLASS_IN = 1;
+
+static void PutU16(std::string& buf, uint16_t v) {
+    buf.push_back((char)(v >> 8));
+    buf.push_back((char)(v & 0xff));
+}
+
+static uint16_t GetU16(const uint8_t* p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t GetU32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// 名字按label编码，不合法的名字返回false
+static bool EncodeQuery(std::string& buf, uint16_t id, const std::string& name, uint16_t qtype) {
+    buf.clear();
+    PutU16(buf, id);
+    PutU16(buf, 0x0100); // RD
+    PutU16(buf, 1);
+    PutU16(buf, 0);
+    PutU16(buf, 0);
+    PutU16(buf, 0);
+    size_t begin = 0;
+    while(begin < name.size()) {
+        size_t end = name.find('.', begin);
+        if(end == std::string::npos) {
+            end = name.size();
+        }
+        size_t len = end - begin;
+        if(len == 0 || len > 63) {
+            return false;
+        }
+        buf.push_back((char)len);
+        buf.append(name, begin, len);
+        begin = end + 1;
+    }
+    buf.push_back(0);
+    if(buf.size() - 12 > 255) {
+        return false;
+    }
+    PutU16(buf, qtype);
+    PutU16(buf, DNS_CLASS_IN);
+    return true;
+}
+
+// 跳过一个名字，支持压缩指针
+static bool SkipName(const uint8_t* data, size_t len, size_t& pos) {
+    while(pos < len) {
+        uint8_t c = data[pos];
+        if(c == 0) {
+            ++pos;
+            return true;
+        }
+        if((c & 0xc0) == 0xc0) {
+            pos += 2;
+            return pos <= len;
+        }
+        if(c & 0xc0) {
+            return false;
+        }
+        pos += 1 + c;
+    }
+    return false;
+}
+
+// 0 有记录，1 域名不存在，-1 回包有问题
+static int DecodeAnswer(const uint8_t* data, size_t len, uint16_t qtype
+        , std::vector<IPAddress::ptr>& addrs, uint32_t& ttl) {
+    if(len < 12) {
+        return -1;
+    }
+    uint16_t flags = GetU16(data + 2);
+    if(!(flags & 0x8000)) {
+        return -1;
+    }
+    int rcode = flags & 0xf;
+    if(rcode == 3) {
+        return 1;
+    } else if(rcode != 0) {
+        return -1;
+    }
+    uint16_t qdcount = GetU16(data + 4);
+    uint16_t ancount = GetU16(data + 6);
+    size_t pos = 12;
+    for(uint16_t i = 0; i < qdcount; ++i) {
+        if(!SkipName(data, len, pos) || pos + 4 > len) {
+            return -1;
+        }
+        pos += 4;
+    }
+    ttl = ~0u;
+    // CNAME链上的记录一起出现在answer里，只取请求的类型
+    for(uint16_t i = 0; i < ancount; ++i) {
+        if(!SkipName(data, len, pos) || pos + 10 > len) {
+            return -1;
+        }
+        uint16_t type = GetU16(data + pos);
+        uint16_t cls = GetU16(data + pos + 2);
+        uint32_t rttl = GetU32(data + pos + 4);
+        uint16_t rdlen = GetU16(data + pos + 8);
+        pos += 10;
+        if(pos + rdlen > len) {
+            return -1;
+        }
+        if(cls == DNS_CLASS_IN && type == qtype) {
+            if(type == DNS_TYPE_A && rdlen == 4) {
+                sockaddr_in addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sin_family = AF_INET;
+                memcpy(&addr.sin_addr, data + pos, 4);
+                addrs.push_back(IPAddress::ptr(new IPv4Address(addr)));
+                ttl = std::min(ttl, rttl);
+            } else if(type == DNS_TYPE_AAAA && rdlen == 16) {
+                addrs.push_back(IPAddress::ptr(new IPv6Address(data + pos)));
+                ttl = std::min(ttl, rttl);
+            }
+        }
+        pos += rdlen;
+    }
+    return addrs.empty() ? 1 : 0;
+}
+
+// ip、ip:port、[ipv6]:port，只接受数字地址
+static IPAddress::ptr ParseAddress(const std::string& str, uint16_t default_port) {
+    std::string ip = str;
+    uint16_t port = default_port;
+    if(!str.empty() && str[0] == '[') {
+        size_t end = str.find(']');
+        if(end == std::string::npos) {
+            return nullptr;
+        }
+        ip = str.substr(1, end - 1);
+        if(end + 1 < str.size() && str[end + 1] == ':') {
+            port = atoi(str.c_str() + end + 2);
+        }
+    } else if(str.find(':') == str.rfind(':') && str.find(':') != std::string::npos) {
+        size_t pos = str.find(':');
+        ip = str.substr(0, pos);
+        port = atoi(str.c_str() + pos + 1);
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    if(inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) == 1) {
+        addr.sin_family = AF_INET;
+        IPAddress::ptr rt(new IPv4Address(addr));
+        rt->setPort(port);
+        return rt;
+    }
+    uint8_t addr6[16];
+    if(inet_pton(AF_INET6, ip.c_str(), addr6) == 1) {
+        return IPAddress::ptr(new IPv6Address(addr6, port));
+    }
+    return nullptr;
+}
+
+static IPAddress::ptr Clone(const IPAddress::ptr& addr) {
+    return std::dynamic_pointer_cast<IPAddress>(Address::Create(addr->getAddr(), addr->getAddrLen()));
+}
+
+static std::string NormalizeName(const std::string& name) {
+    std::string rt = name;
+    if(!rt.empty() && rt[rt.size() - 1] == '.') {
+        rt.resize(rt.size() - 1);
+    }
+    for(auto& c : rt) {
+        c = tolower(c);
+    }
+    return rt;
+}
+
+bool DnsResolver::LoadHosts(const std::string& path
+        , std::unordered_map<std::string, std::vector<IPAddress::ptr> >& hosts) {
+    std::ifstream ifs(path);
+    if(!ifs) {
+        return false;
+    }
+    std::string line;
+    while(std::getline(ifs, line)) {
+        size_t comment = line.find('#');
+        if(comment != std::string::npos) {
+            line.resize(comment);
+        }
+        std::istringstream iss(line);
+        std::string ip;
+        if(!(iss >> ip)) {
+            continue;
+        }
+        IPAddress::ptr addr = ParseAddress(ip, 0);
+        if(!addr) {
+            continue;
+        }
+        std::string name;
+        while(iss >> name) {
+            hosts[NormalizeName(name)].push_back(addr);
+        }
+    }
+    return true;
+}
+
+DnsResolver::DnsResolver() {
+    // hosts文件、服务器列表变化后下次解析时重新加载
+    auto reload = [this]() {
+        RWMutexType::WriteLock lock(m_mutex);
+        m_loaded = false;
+    };
+    g_dns_servers->addListener([reload](const std::vector<std::string>& old_value
+                , const std::vector<std::string>& new_value) {
+        reload();
+    });
+    g_dns_hosts_file->addListener([reload](const std::string& old_value
+                , const std::string& new_value) {
+        reload();
+    });
+}
+
+bool DnsResolver::IsEnabled() {
+    return g_dns_enable->getValue();
+}
+
+void DnsResolver::load() {
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        if(m_loaded) {
+            return;
+        }
+    }
+    std::unordered_map<std::string, std::vector<IPAddress::ptr> > hosts;
+    std::vector<Address::ptr> servers;
+    BlockingPoolMgr::GetInstance()->run([&hosts, &servers]() {
+        std::string path = g_dns_hosts_file->getValue();
+        if(!path.empty()) {
+            LoadHosts(path, hosts);
+        }
+
+        std::vector<std::string> names = g_dns_servers->getValue();
+        if(names.empty()) {
+            std::ifstream ifs("/etc/resolv.conf");
+            std::string line;
+            while(std::getline(ifs, line)) {
+                std::istringstream iss(line);
+                std::string key, value;
+                if(iss >> key >> value && key == "nameserver") {
+                    names.push_back(value);
+                }
+            }
+        }
+        for(auto& i : names) {
+            IPAddress::ptr addr = ParseAddress(i, 53);
+            if(addr) {
+                servers.push_back(addr);
+            } else {
+                ORANGE_LOG_ERROR(g_logger) << "invalid dns server " << i;
+            }
+        }
+    });
+    if(servers.empty()) {
+        ORANGE_LOG_ERROR(g_logger) << "no dns server";
+    }
+
+    RWMutexType::WriteLock lock(m_mutex);
+    m_hosts.swap(hosts);
+    m_servers.swap(servers);
+    m_loaded = true;
+}
+
+bool DnsResolver::resolve(const std::string& host, int family, std::vector<IPAddress::ptr>& result) {
+    std::string name = NormalizeName(host);
+    if(name.empty()) {
+        return false;
+    }
+    load();
+
+    size_t old_size = result.size();
+    lookupHosts(name, family, result);
+    if(result.size() > old_size) {
+        ++m_hits;
+        return true;
+    }
+
+    uint16_t qtypes[2];
+    int count = 0;
+    if(family != AF_INET6) {
+        qtypes[count++] = DNS_TYPE_A;
+    }
+    if(family != AF_INET) {
+        qtypes[count++] = DNS_TYPE_AAAA;
+    }
+    for(int i = 0; i < count; ++i) {
+        std::string key = name + (qtypes[i] == DNS_TYPE_A ? "/A" : "/AAAA");
+        bool found = false;
+        if(lookupCache(key, result, found)) {
+            if(found) {
+                ++m_hits;
+            } else {
+                ++m_negativeHits;
+            }
+            continue;
+        }
+        ++m_misses;
+
+        std::vector<IPAddress::ptr> addrs;
+        uint32_t ttl = 0;
+        int rt = query(name, qtypes[i], addrs, ttl);
+        if(rt < 0) {
+            ++m_failures;
+            continue;
+        }
+        addCache(key, addrs, rt == 0 ? ttl : g_dns_negative_ttl->getValue());
+        for(auto& a : addrs) {
+            result.push_back(a);
+        }
+    }
+    return result.size() > old_size;
+}
+
+int DnsResolver::query(const std::string& name, uint16_t qtype
+        , std::vector<IPAddress::ptr>& addrs, uint32_t& ttl) {
+    std::vector<Address::ptr> servers = getServers();
+    uint32_t attempts = std::max(g_dns_attempts->getValue(), 1u);
+    for(uint32_t i = 0; i < attempts; ++i) {
+        for(auto& server : servers) {
+            int rt = queryServer(server, name, qtype, addrs, ttl);
+            if(rt >= 0) {
+                return rt;
+            }
+        }
+    }
+    ORANGE_LOG_ERROR(g_logger) << "dns query " << name << " type=" << qtype << " fail";
+    return -1;
+}
+
+int DnsResolver::queryServer(Address::ptr server, const std::string& name, uint16_t qtype
+        , std::vector<IPAddress::ptr>& addrs, uint32_t& ttl) {
+    static thread_local std::mt19937 s_rand(std::random_device{}());
+    uint16_t id = (uint16_t)s_rand();
+    std::string req;
+    if(!EncodeQuery(req, id, name, qtype)) {
+        return 1;
+    }
+
+    // 每次查询用新的socket，源端口随机；connect之后内核只收这个服务器的回包
+    Socket::ptr sock = Socket::CreateUDP(server);
+    if(!sock->connect(server)) {
+        return -1;
+    }
+    sock->setRecvTimeout(g_dns_timeout_ms->getValue());
+    ++m_queries;
+    if(sock->send(req.c_str(), req.size()) != (int)req.size()) {
+        return -1;
+    }
+    uint8_t buf[1500];
+    while(true) {
+        // 超时或者ICMP端口不可达
+        int n = sock->recv(buf, sizeof(buf));
+        if(n <= 0) {
+            return -1;
+        }
+        if(n < 2 || GetU16(buf) != id) {
+            continue;
+        }
+        int rt = DecodeAnswer(buf, n, qtype, addrs, ttl);
+        // 截断的回包也按拿到的记录处理，不回退到TCP
+        return rt;
+    }
+}
+
+bool DnsResolver::lookupCache(const std::string& key, std::vector<IPAddress::ptr>& result, bool& found) {
+    RWMutexType::ReadLock lock(m_mutex);
+    auto it = m_cache.find(key);
+    if(it == m_cache.end() || it->second.expireMs <= orange::GetCachedMS()) {
+        return false;
+    }
+    found = !it->second.addrs.empty();
+    for(auto& i : it->second.addrs) {
+        result.push_back(Clone(i));
+    }
+    return true;
+}
+
+void DnsResolver::addCache(const std::string& key, const std::vector<IPAddress::ptr>& addrs, uint32_t ttl) {
+    // TTL为0的记录不缓存
+    if(ttl == 0) {
+        return;
+    }
+    uint64_t now = orange::GetCachedMS();
+    Entry entry;
+    for(auto& i : addrs) {
+        entry.addrs.push_back(Clone(i));
+    }
+    entry.expireMs = now + ttl * 1000ull;
+
+    RWMutexType::WriteLock lock(m_mutex);
+    if(m_cache.size() >= g_dns_cache_size->getValue() && !m_cache.count(key)) {
+        for(auto it = m_cache.begin(); it != m_cache.end();) {
+            if(it->second.expireMs <= now) {
+                it = m_cache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if(!m_cache.empty() && m_cache.size() >= g_dns_cache_size->getValue()) {
+            m_cache.erase(m_cache.begin());
+        }
+    }
+    m_cache[key] = std::move(entry);
+}
+
+void DnsResolver::lookupHosts(const std::string& name, int family, std::vector<IPAddress::ptr>& result) {
+    RWMutexType::ReadLock lock(m_mutex);
+    auto it = m_hosts.find(name);
+    if(it == m_hosts.end()) {
+        return;
+    }
+    for(auto& i : it->second) {
+        if(family == AF_UNSPEC || i->getFamily() == family) {
+            result.push_back(Clone(i));
+        }
+    }
+}
+
+std::vector<Address::ptr> DnsResolver::getServers() {
+    RWMutexType::ReadLock lock(m_mutex);
+    return m_servers;
+}
+
+void DnsResolver::clearCache() {
+    RWMutexType::WriteLock lock(m_mutex);
+    m_cache.clear();
+}
+
+DnsResolver::Stat DnsResolver::getStat() {
+    Stat stat;
+    stat.hits = m_hits;
+    stat.negativeHits = m_negativeHits;
+    stat.misses = m_misses;
+    stat.queries = m_queries;
+    stat.failures = m_failures;
+    return stat;
+}
+
+} // namespace orange
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "address.h"
+#include "mutex.h"
+#include "singleton.h"
+
+namespace orange {
+
+/*
+* 协程化的DNS解析：在hook的UDP socket上发查询，等待回包时只挂起当前协程
+* 先查hosts文件，再查缓存(按记录的TTL过期，查不到的域名按dns.negative_ttl缓存)，最后查询DNS服务器
+* dns.enable打开后Address::Lookup对域名使用它，否则仍然是getaddrinfo
+*/
+class DnsResolver {
+public:
+    typedef RWMutex RWMutexType;
+
+    struct Stat {
+        uint64_t hits = 0;          // 缓存命中(包括hosts)
+        uint64_t negativeHits = 0;  // 命中"域名不存在"的缓存
+        uint64_t misses = 0;
+        uint64_t queries = 0;       // 发出的查询包
+        uint64_t failures = 0;      // 超时、服务器出错，不缓存
+    };
+
+    DnsResolver();
+
+    /*
+    * 解析域名，family为AF_INET、AF_INET6或AF_UNSPEC，结果的端口为0，每次返回新的对象
+    * 域名不存在或者所有服务器都失败时返回false
+    */
+    bool resolve(const std::string& name, int family, std::vector<IPAddress::ptr>& result);
+
+    void clearCache();
+    Stat getStat();
+
+    static bool IsEnabled();
+
+    /*
+    * 读取hosts格式的文件(每行: ip 名字 [别名...]，#后为注释)，名字转为小写
+    */
+    static bool LoadHosts(const std::string& path
+            , std::unordered_map<std::string, std::vector<IPAddress::ptr> >& hosts);
+
+private:
+    struct Entry {
+        std::vector<IPAddress::ptr> addrs;
+        uint64_t expireMs = 0;
+    };
+
+    // 0 成功，1 域名不存在(NXDOMAIN或没有对应记录)，-1 失败
+    int query(const std::string& name, uint16_t qtype
+            , std::vector<IPAddress::ptr>& addrs, uint32_t& ttl);
+    int queryServer(Address::ptr server, const std::string& name, uint16_t qtype
+            , std::vector<IPAddress::ptr>& addrs, uint32_t& ttl);
+    // 返回是否命中，命中时found表示是否有地址
+    bool lookupCache(const std::string& key, std::vector<IPAddress::ptr>& result, bool& found);
+    void addCache(const std::string& key, const std::vector<IPAddress::ptr>& addrs, uint32_t ttl);
+    void lookupHosts(const std::string& name, int family, std::vector<IPAddress::ptr>& result);
+    std::vector<Address::ptr> getServers();
+    void load();
+
+private:
+    RWMutexType m_mutex;
+    std::unordered_map<std::string, Entry> m_cache;
+    std::unordered_map<std::string, std::vector<IPAddress::ptr> > m_hosts;
+    std::vector<Address::ptr> m_servers;
+    // hosts和服务器列表在第一次解析时加载，配置变化后重新加载
+    bool m_loaded = false;
+
+    std::atomic<uint64_t> m_hits = {0};
+    std::atomic<uint64_t> m_negativeHits = {0};
+    std::atomic<uint64_t> m_misses = {0};
+    std::atomic<uint64_t> m_queries = {0};
+    std::atomic<uint64_t> m_failures = {0};
+};
+
+typedef orange::Singleton<DnsResolver> DnsMgr;
+
+} // namespace orange
@@ -11,12 +11,15 @@ namespace orange {
 FdCtx::FdCtx(int fd) 
     :m_isInit(false)
     ,m_isSocket(false)
+    ,m_isFile(false)
     ,m_sysNonblock(false)
     ,m_userNonblock(false)
     ,m_isClosed(false)
     ,m_fd(fd)
     ,m_recvTimeout(-1)
     ,m_sendTimeout(-1) {
+    m_waitSeq[0] = 0;
+    m_waitSeq[1] = 0;
     init();
 }
 
@@ -34,9 +37,11 @@ bool FdCtx::init() {
     if(-1 == fstat(m_fd, &fd_stat)) {
         m_isInit = false;
         m_isSocket = false;
+        m_isFile = false;
     } else {
         m_isInit = true;
         m_isSocket = S_ISSOCK(fd_stat.st_mode);
+        m_isFile = S_ISREG(fd_stat.st_mode);
     }
     if(m_isSocket) {
         int flag = fcntl_f(m_fd, F_GETFL, 0);
@@ -76,6 +81,21 @@ void FdCtx::setTimeout(int type, uint64_t timeout) {
     }
 }
 
+uint64_t FdCtx::beginWait(int type) {
+    std::atomic<uint64_t>& seq = m_waitSeq[type == SO_RCVTIMEO ? 0 : 1];
+    uint64_t next = (seq.load(std::memory_order_relaxed) & ~1ull) + 2;
+    seq.store(next, std::memory_order_relaxed);
+    return next;
+}
+
+bool FdCtx::markTimedOut(int type, uint64_t seq) {
+    return m_waitSeq[type == SO_RCVTIMEO ? 0 : 1].compare_exchange_strong(seq, seq | 1);
+}
+
+bool FdCtx::isTimedOut(int type, uint64_t seq) const {
+    return m_waitSeq[type == SO_RCVTIMEO ? 0 : 1].load() == (seq | 1);
+}
+
 FdManager::FdManager() {
     m_datas.resize(64);
 }
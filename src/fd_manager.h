@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -17,8 +18,13 @@ public:
     bool init();
     bool isInit() const { return m_isInit; }
     bool isSocket() const { return m_isSocket; }
+    // 普通文件，读写会阻塞且不能用epoll等待
+    bool isFile() const { return m_isFile; }
     bool isClose() const { return m_isClosed; }
     bool close();
+    // hook的close在真正关闭fd之前标记
+    void setClose() { m_isClosed = true; }
+    int getFd() const { return m_fd; }
 
     bool getSysNonblock() const { return m_sysNonblock; }
     void setSysNonblock(bool v) { m_sysNonblock = v; }
@@ -29,15 +35,27 @@ public:
     uint64_t getTimeout(int type);
     void setTimeout(int type, uint64_t timeout);
 
+    /*
+    * 带超时的等待，type为SO_RCVTIMEO(读)或SO_SNDTIMEO(写)
+    * 协程挂起前取一个新的序号，超时定时器带着序号回来，序号已变说明是旧的定时器
+    */
+    uint64_t beginWait(int type);
+    // seq仍是当前的等待时标记为超时，返回是否标记成功
+    bool markTimedOut(int type, uint64_t seq);
+    bool isTimedOut(int type, uint64_t seq) const;
+
 private:
     bool m_isInit = false;
     bool m_isSocket = false;
+    bool m_isFile = false;
     bool m_sysNonblock = false;
     bool m_userNonblock = false;
     bool m_isClosed = false;
     int m_fd;
     uint64_t m_recvTimeout;
     uint64_t m_sendTimeout;
+    // 读写各一个等待序号，最低位表示已超时。同一方向同时只有一个协程等待
+    std::atomic<uint64_t> m_waitSeq[2];
 };
 
 class FdManager {
@@ -1,5 +1,10 @@
 #include "fiber.h"
 
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include <atomic>
 #include <exception>
 
@@ -21,6 +26,20 @@ static orange::ConfigVar<uint32_t>::ptr g_fiber_stack_size =
 
 static orange::Logger::ptr g_logger = ORANGE_LOG_NAME("system");
 
+/*
+* mmap的栈带保护页，每个栈占两个映射区，受vm.max_map_count(默认65530)限制，
+* 默认配置下最多约3.2万个协程同时存活；大量连接时要先调大max_map_count再打开
+*/
+static orange::ConfigVar<std::string>::ptr g_fiber_stack_allocator =
+    orange::Config::Lookup<std::string>("fiber.stack_allocator", "malloc"
+            , "fiber stack allocator, malloc or mmap(guard page, 2 maps per fiber, see vm.max_map_count)");
+
+static orange::ConfigVar<uint32_t>::ptr g_fiber_stack_cache =
+    orange::Config::Lookup<uint32_t>("fiber.stack_cache", 64, "mmap stack cache count per size class per thread");
+
+static orange::ConfigVar<uint32_t>::ptr g_fiber_shared_stack_size =
+    orange::Config::Lookup<uint32_t>("fiber.shared_stack_size", 1024 * 1024, "per thread shared fiber stack size");
+
 class MallocStackAllocator {
 public:
     static void* Alloc(size_t size) {
@@ -32,38 +51,201 @@ public:
     }
 };
 
-using StackAllocator = MallocStackAllocator;
+/*
+* mmap分配协程栈，栈底(低地址)放一个PROT_NONE的保护页，栈溢出时直接段错误
+* 栈大小按2的幂分级，每个线程每个级别一个空闲链表，链表指针存放在栈内存里
+*/
+class MmapStackAllocator {
+public:
+    static void* Alloc(size_t size) {
+        int cls = SizeClass(size);
+        Cache& cache = GetCache();
+        if(cls < MAX_CLASS && cache.heads[cls]) {
+            FreeStack* fs = cache.heads[cls];
+            cache.heads[cls] = fs->next;
+            --cache.counts[cls];
+            return fs;
+        }
+        return Map(size);
+    }
+
+    static void Dealloc(void* vp, size_t size) {
+        int cls = SizeClass(size);
+        Cache& cache = GetCache();
+        if(cls < MAX_CLASS && cache.counts[cls] < g_fiber_stack_cache->getValue()) {
+            FreeStack* fs = (FreeStack*)vp;
+            fs->next = cache.heads[cls];
+            cache.heads[cls] = fs;
+            ++cache.counts[cls];
+            return;
+        }
+        Unmap(vp, size);
+    }
+
+    // 不经过缓存直接映射
+    static void* Map(size_t size) {
+        size_t page = PageSize();
+        size_t len = ClassSize(size) + page;
+        void* base = mmap(nullptr, len, PROT_READ | PROT_WRITE
+                        , MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+        if(base == MAP_FAILED) {
+            ORANGE_LOG_ERROR(g_logger) << "mmap stack size=" << len
+                << " errno=" << errno << " errstr=" << strerror(errno);
+            return nullptr;
+        }
+        if(mprotect(base, page, PROT_NONE)) {
+            ORANGE_LOG_ERROR(g_logger) << "mprotect guard page errno=" << errno
+                << " errstr=" << strerror(errno);
+            munmap(base, len);
+            return nullptr;
+        }
+        return (char*)base + page;
+    }
+
+    static void Unmap(void* vp, size_t size) {
+        size_t page = PageSize();
+        munmap((char*)vp - page, ClassSize(size) + page);
+    }
+
+private:
+    // 4K, 8K ... 128M
+    static const int MAX_CLASS = 16;
+
+    struct FreeStack {
+        FreeStack* next;
+    };
+
+    struct Cache {
+        FreeStack* heads[MAX_CLASS] = {nullptr};
+        uint32_t counts[MAX_CLASS] = {0};
+
+        ~Cache() {
+            for(int i = 0; i < MAX_CLASS; ++i) {
+                while(FreeStack* fs = heads[i]) {
+                    heads[i] = fs->next;
+                    Unmap(fs, PageSize() << i);
+                }
+            }
+        }
+    };
+
+    static size_t PageSize() {
+        static size_t s_page = sysconf(_SC_PAGESIZE);
+        return s_page;
+    }
+
+    static size_t ClassSize(size_t size) {
+        size_t cls_size = PageSize();
+        while(cls_size < size) {
+            cls_size <<= 1;
+        }
+        return cls_size;
+    }
+
+    static int SizeClass(size_t size) {
+        int cls = 0;
+        for(size_t cls_size = PageSize(); cls_size < size; cls_size <<= 1) {
+            ++cls;
+        }
+        return cls;
+    }
+
+    static Cache& GetCache() {
+        static thread_local Cache s_cache;
+        return s_cache;
+    }
+};
+
+static bool s_mmap_stack = false;
+
+struct _FiberIniter {
+    _FiberIniter() {
+        s_mmap_stack = g_fiber_stack_allocator->getValue() != "malloc";
+        g_fiber_stack_allocator->addListener([](const std::string& old_value, const std::string& new_value) {
+            ORANGE_LOG_INFO(g_logger) << "fiber stack allocator changed from "
+                                      << old_value << " to " << new_value;
+            s_mmap_stack = new_value != "malloc";
+        });
+    }
+};
+
+static _FiberIniter s_fiber_initer;
+
+static void* StackAlloc(size_t size, bool mmap_stack) {
+    if(mmap_stack) {
+        return MmapStackAllocator::Alloc(size);
+    }
+    return MallocStackAllocator::Alloc(size);
+}
+
+static void StackDealloc(void* vp, size_t size, bool mmap_stack) {
+    if(mmap_stack) {
+        MmapStackAllocator::Dealloc(vp, size);
+    } else {
+        MallocStackAllocator::Dealloc(vp, size);
+    }
+}
+
+/*
+* 每个线程一个共享栈，记录当前栈上是哪个协程的内容
+* 换入其他协程时才保存原来的内容(惰性保存)，协程结束时不需要保存
+*/
+struct SharedStack {
+    void* stack = nullptr;
+    size_t size = 0;
+    Fiber* occupant = nullptr;
+
+    ~SharedStack() {
+        if(stack) {
+            MmapStackAllocator::Unmap(stack, size);
+        }
+    }
+};
+
+static SharedStack& GetSharedStack() {
+    static thread_local SharedStack s_stack;
+    if(!s_stack.stack) {
+        s_stack.size = g_fiber_shared_stack_size->getValue();
+        s_stack.stack = MmapStackAllocator::Map(s_stack.size);
+        ORANGE_ASSERT2(s_stack.stack, "alloc shared stack");
+    }
+    return s_stack;
+}
 
 Fiber::Fiber() {
     m_state = EXEC;
     SetThis(this);
-    
-    if(getcontext(&m_ctx)) {
-        ORANGE_ASSERT2(false, "getcontext");
-    }
 
     ++s_fiber_count;
     ORANGE_LOG_DEBUG(g_logger) << "Fiber::Fiber id = " << m_id;
  }
 
-Fiber::Fiber(std::function<void()> cb, size_t stackSize /* = 0 */, bool use_call /* = false */) 
+Fiber::Fiber(std::function<void()> cb, size_t stackSize /* = 0 */, bool use_call /* = false */
+            , bool shared_stack /* = false */)
     :m_id(++s_fiber_id)
     ,m_cb(cb) {
     m_state = INIT;
+    ++s_fiber_count;
+#ifdef ORANGE_FIBER_ASM
+    if(shared_stack) {
+        // 第一次换入时才在共享栈上初始化上下文
+        m_sharedStack = true;
+        m_entry = use_call ? Fiber::CallerMainFunc : Fiber::MainFunc;
+        ORANGE_LOG_DEBUG(g_logger) << "Fiber::Fiber(x, x) shared stack id = " << m_id;
+        return;
+    }
+#endif
     m_stackSize = stackSize != 0 ? stackSize : g_fiber_stack_size->getValue();
 
-    if(getcontext(&m_ctx)) {
-        ORANGE_ASSERT2(false, "getcontext");
-    }
-    m_stack = StackAllocator::Alloc(m_stackSize);
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stackSize;
+    // 分配方式跟着协程走，配置变更后旧协程仍按原方式释放
+    m_mmapStack = s_mmap_stack;
+    m_stack = StackAlloc(m_stackSize, m_mmapStack);
+    ORANGE_ASSERT2(m_stack, "alloc fiber stack");
 
     if(use_call) {
-        makecontext(&m_ctx, Fiber::CallerMainFunc, 0);
+        MakeFiberContext(&m_ctx, m_stack, m_stackSize, Fiber::CallerMainFunc);
     } else {
-        makecontext(&m_ctx, Fiber::MainFunc, 0);
+        MakeFiberContext(&m_ctx, m_stack, m_stackSize, Fiber::MainFunc);
     }
     ORANGE_LOG_DEBUG(g_logger) << "Fiber::Fiber(x, x) id = " << m_id;
 }
@@ -71,11 +253,16 @@ Fiber::Fiber(std::function<void()> cb, size_t stackSize /* = 0 */, bool use_call
 Fiber::~Fiber() {
     ORANGE_LOG_DEBUG(g_logger) << "Fiber::~Fiber id = " << m_id;
     --s_fiber_count;
-    if(m_stack) {
+    if(m_sharedStack) {
+        ORANGE_ASSERT(m_state == INIT
+                || m_state == EXCPT
+                || m_state == TERM);
+        free(m_saveBuf);
+    } else if(m_stack) {
         ORANGE_ASSERT(m_state == INIT
                 || m_state == EXCPT
                 || m_state == TERM);
-        StackAllocator::Dealloc(m_stack, m_stackSize);
+        StackDealloc(m_stack, m_stackSize, m_mmapStack);
     } else {
         ORANGE_ASSERT(!m_cb);
         ORANGE_ASSERT(m_state == EXEC);
@@ -88,54 +275,104 @@ Fiber::~Fiber() {
 }
 
 void Fiber::reset(std::function<void()> cb) {
-    ORANGE_ASSERT(m_stack);
+    ORANGE_ASSERT(m_stack || m_sharedStack);
     ORANGE_ASSERT(m_state == INIT
             || m_state == EXCPT
             || m_state == TERM);
     
     m_cb = cb;
-    if(getcontext(&m_ctx)) {
-        ORANGE_ASSERT2(false, "getcontext");
+    if(m_sharedStack) {
+        m_entry = Fiber::MainFunc;
+        m_saveSize = 0;
+    } else {
+        MakeFiberContext(&m_ctx, m_stack, m_stackSize, Fiber::MainFunc);
     }
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stackSize;
-    makecontext(&m_ctx, Fiber::MainFunc, 0);
     m_state = INIT;
 }
 
+void Fiber::enterSharedStack() {
+    SharedStack& ss = GetSharedStack();
+    if(m_thread == -1) {
+        m_thread = orange::GetThreadId();
+    }
+    ORANGE_ASSERT2(m_thread == orange::GetThreadId(), "shared stack fiber resumed on other thread");
+    if(ss.occupant == this) {
+        return;
+    }
+    if(ss.occupant) {
+        ss.occupant->saveSharedStack();
+    }
+    if(m_state == INIT) {
+        MakeFiberContext(&m_ctx, ss.stack, ss.size, m_entry);
+    } else {
+        char* top = (char*)ss.stack + ss.size;
+        memcpy(top - m_saveSize, m_saveBuf, m_saveSize);
+    }
+    ss.occupant = this;
+}
+
+void Fiber::leaveSharedStack() {
+    // 结束后栈上的内容不再需要
+    if(m_state == TERM || m_state == EXCPT) {
+        SharedStack& ss = GetSharedStack();
+        if(ss.occupant == this) {
+            ss.occupant = nullptr;
+        }
+        m_saveSize = 0;
+    }
+}
+
+void Fiber::saveSharedStack() {
+#ifdef ORANGE_FIBER_ASM
+    SharedStack& ss = GetSharedStack();
+    char* top = (char*)ss.stack + ss.size;
+    char* sp = (char*)m_ctx;
+    m_saveSize = top - sp;
+    if(m_saveCap < m_saveSize) {
+        m_saveCap = m_saveSize;
+        m_saveBuf = (char*)realloc(m_saveBuf, m_saveCap);
+        ORANGE_ASSERT2(m_saveBuf, "alloc shared stack save buffer");
+    }
+    memcpy(m_saveBuf, sp, m_saveSize);
+#endif
+}
+
 void Fiber::call() {
     SetThis(this);
     ORANGE_ASSERT(m_state != EXEC);
+    if(m_sharedStack) {
+        enterSharedStack();
+    }
     m_state = EXEC;
     
-    if(swapcontext(&(t_fiberThread->m_ctx), &m_ctx)) {
-        ORANGE_ASSERT2(false, "call swapcontext");
+    SwapFiberContext(&(t_fiberThread->m_ctx), &m_ctx);
+    if(m_sharedStack) {
+        leaveSharedStack();
     }
 }
 
 void Fiber::back() {
     SetThis(t_fiberThread.get());
-    if(swapcontext(&m_ctx, &(t_fiberThread->m_ctx))) {
-        ORANGE_ASSERT2(false, "back swapcontext");
-    }
+    SwapFiberContext(&m_ctx, &(t_fiberThread->m_ctx));
 }
 
 void Fiber::swapIn() {
     SetThis(this);
     ORANGE_ASSERT(m_state != EXEC);
+    if(m_sharedStack) {
+        enterSharedStack();
+    }
     m_state = EXEC;
 
-    if(swapcontext(&(Scheduler::GetMainFiber()->m_ctx), &m_ctx)) {
-        ORANGE_ASSERT2(false, "swapin swapcontext");
+    SwapFiberContext(&(Scheduler::GetMainFiber()->m_ctx), &m_ctx);
+    if(m_sharedStack) {
+        leaveSharedStack();
     }
 }
 
 void Fiber::swapOut() {
     SetThis(Scheduler::GetMainFiber());
-    if(swapcontext(&m_ctx, &(Scheduler::GetMainFiber()->m_ctx))) {
-        ORANGE_ASSERT2(false, "swapout swapcontext");
-    }
+    SwapFiberContext(&m_ctx, &(Scheduler::GetMainFiber()->m_ctx));
 }
 
 uint64_t Fiber::GetFiberId() {
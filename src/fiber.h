@@ -1,9 +1,8 @@
 #pragma once
 
-#include <ucontext.h>
-
 #include <memory>
 #include <functional>
+#include "fiber_context.h"
 #include "mutex.h"
 
 namespace orange {
@@ -27,11 +26,21 @@ private:
     Fiber();
 
 public:
-    Fiber(std::function<void()> cb, size_t stackSize = 0, bool use_call = false);
+    /**
+     * shared_stack为true时使用线程共享栈，切出时只保存用到的部分，适合大量挂起的协程。
+     * 共享栈协程第一次运行后只能在该线程上恢复，并且挂起期间其他协程不能访问它栈上的对象。
+     * 使用ucontext切换时不支持，退化为独立栈
+     */
+    Fiber(std::function<void()> cb, size_t stackSize = 0, bool use_call = false
+            , bool shared_stack = false);
     ~Fiber();
 
     uint64_t getId() const { return m_id; }
     State getState() const { return m_state; }
+    uint32_t getStackSize() const { return m_stackSize; }
+    bool isSharedStack() const { return m_sharedStack; }
+    // 共享栈协程运行过后绑定的线程，其他协程返回-1
+    int getPinnedThread() const { return m_thread; }
     void setState(Fiber::State state) { m_state = state; }
     void reset(std::function<void()> cb);
 
@@ -51,14 +60,28 @@ public:
     static void MainFunc();
     static void CallerMainFunc();
 
+private:
+    void enterSharedStack();
+    void leaveSharedStack();
+    void saveSharedStack();
+
 private:
     uint64_t m_id = 0;
     uint32_t m_stackSize = 0;
+    bool m_mmapStack = false;
     State m_state = INIT;
 
-    ucontext_t m_ctx;
+    FiberContext m_ctx;
     void* m_stack = nullptr;
 
+    // 共享栈模式，切出后栈内容保存在m_saveBuf
+    bool m_sharedStack = false;
+    int m_thread = -1;
+    void (*m_entry)() = nullptr;
+    char* m_saveBuf = nullptr;
+    size_t m_saveSize = 0;
+    size_t m_saveCap = 0;
+
     std::function<void()> m_cb;
 }; 
 
@@ -0,0 +1,141 @@
+#include "fiber_context.h"
+
+#include <stdint.h>
+
+#include "log.h"
+#include "macro.h"
+
+#ifdef ORANGE_FIBER_ASM
+
+// 只保存callee-saved寄存器，不切换信号掩码
+extern "C" void orange_switch_context(void** from_sp, void* to_sp);
+
+#if defined(__x86_64__)
+/*
+* 栈布局(低地址到高地址): x87控制字, mxcsr, r15, r14, r13, r12, rbx, rbp, 返回地址
+*/
+asm(R"(
+    .text
+    .globl orange_switch_context
+    .type orange_switch_context, @function
+    .align 16
+orange_switch_context:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $16, %rsp
+    stmxcsr 8(%rsp)
+    fnstcw (%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    fldcw (%rsp)
+    ldmxcsr 8(%rsp)
+    addq $16, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size orange_switch_context, .-orange_switch_context
+)");
+#elif defined(__aarch64__)
+/*
+* 栈布局(低地址到高地址): x19-x28, x29, x30(返回地址), d8-d15
+*/
+asm(R"(
+    .text
+    .globl orange_switch_context
+    .type orange_switch_context, %function
+    .align 4
+orange_switch_context:
+    sub sp, sp, #0xa0
+    stp x19, x20, [sp, #0x00]
+    stp x21, x22, [sp, #0x10]
+    stp x23, x24, [sp, #0x20]
+    stp x25, x26, [sp, #0x30]
+    stp x27, x28, [sp, #0x40]
+    stp x29, x30, [sp, #0x50]
+    stp d8, d9, [sp, #0x60]
+    stp d10, d11, [sp, #0x70]
+    stp d12, d13, [sp, #0x80]
+    stp d14, d15, [sp, #0x90]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp x19, x20, [sp, #0x00]
+    ldp x21, x22, [sp, #0x10]
+    ldp x23, x24, [sp, #0x20]
+    ldp x25, x26, [sp, #0x30]
+    ldp x27, x28, [sp, #0x40]
+    ldp x29, x30, [sp, #0x50]
+    ldp d8, d9, [sp, #0x60]
+    ldp d10, d11, [sp, #0x70]
+    ldp d12, d13, [sp, #0x80]
+    ldp d14, d15, [sp, #0x90]
+    add sp, sp, #0xa0
+    ret
+    .size orange_switch_context, .-orange_switch_context
+)");
+#endif
+
+namespace orange {
+
+void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*func)()) {
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+#if defined(__x86_64__)
+    // ret到func时rsp指向一个为0的假返回地址，和正常call进入函数时的对齐一致
+    uint64_t* sp = (uint64_t*)top;
+    *--sp = 0;
+    *--sp = (uint64_t)func;
+    sp -= 6;
+    for(int i = 0; i < 6; ++i) {
+        sp[i] = 0;
+    }
+    sp -= 2;
+    sp[0] = 0x037f;     // x87控制字默认值
+    sp[1] = 0x1f80;     // mxcsr默认值
+    *ctx = sp;
+#elif defined(__aarch64__)
+    uint64_t* sp = (uint64_t*)(top - 0xa0);
+    for(int i = 0; i < 0xa0 / 8; ++i) {
+        sp[i] = 0;
+    }
+    sp[11] = (uint64_t)func;   // x30
+    *ctx = sp;
+#endif
+}
+
+void SwapFiberContext(FiberContext* from, FiberContext* to) {
+    orange_switch_context(from, *to);
+}
+
+} // namespace orange
+
+#else
+
+namespace orange {
+
+void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*func)()) {
+    if(getcontext(ctx)) {
+        ORANGE_ASSERT2(false, "getcontext");
+    }
+    ctx->uc_link = nullptr;
+    ctx->uc_stack.ss_sp = stack;
+    ctx->uc_stack.ss_size = size;
+    makecontext(ctx, func, 0);
+}
+
+void SwapFiberContext(FiberContext* from, FiberContext* to) {
+    if(swapcontext(from, to)) {
+        ORANGE_ASSERT2(false, "swapcontext");
+    }
+}
+
+} // namespace orange
+
+#endif
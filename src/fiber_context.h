@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+
+// x86-64、aarch64默认使用汇编切换上下文，其他平台或定义了ORANGE_FIBER_UCONTEXT时使用ucontext
+#if !defined(ORANGE_FIBER_UCONTEXT) && (defined(__x86_64__) || defined(__aarch64__))
+#define ORANGE_FIBER_ASM 1
+#else
+#include <ucontext.h>
+#endif
+
+namespace orange {
+
+#ifdef ORANGE_FIBER_ASM
+// 切出时保存callee-saved寄存器后的栈指针
+typedef void* FiberContext;
+#else
+typedef ucontext_t FiberContext;
+#endif
+
+/**
+ * 在栈上初始化上下文，切入后从func开始执行，func不能返回
+ */
+void MakeFiberContext(FiberContext* ctx, void* stack, size_t size, void (*func)());
+
+/**
+ * 保存当前上下文到from，切换到to
+ */
+void SwapFiberContext(FiberContext* from, FiberContext* to);
+
+} // namespace orange
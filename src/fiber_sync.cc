@@ -0,0 +1,171 @@
+#include "fiber_sync.h"
+
+#include "hook.h"
+#include "log.h"
+#include "macro.h"
+#include "scheduler.h"
+#include "util.h"
+
+namespace orange {
+
+bool FiberWaiter::init(Semaphore* thread_sem) {
+    // hook只在调度线程上开启，调度协程自己不能挂起
+    if(is_hook_enable() && Scheduler::GetThis()) {
+        Fiber::ptr cur = Fiber::GetThis();
+        if(cur.get() != Scheduler::GetMainFiber()) {
+            scheduler = Scheduler::GetThis();
+            fiber = std::move(cur);
+            return true;
+        }
+    }
+    sem = thread_sem;
+    return false;
+}
+
+void FiberWaiter::wake() {
+    if(fiber) {
+        // 对方可能还没切出，调度器会等它切出后再运行
+        Fiber::ptr f;
+        f.swap(fiber);
+        scheduler->schedule(std::move(f));
+    } else {
+        sem->notify();
+    }
+}
+
+bool FiberWaitQueue::pop(FiberWaiter& waiter) {
+    if(m_waiters.empty()) {
+        return false;
+    }
+    waiter = std::move(m_waiters.front());
+    m_waiters.pop_front();
+    return true;
+}
+
+void FiberWaitQueue::popAll(std::deque<FiberWaiter>& waiters) {
+    waiters.swap(m_waiters);
+    m_waiters.clear();
+}
+
+void FiberMutex::lock() {
+    SpinLock::Lock lock(m_mutex);
+    if(!m_locked) {
+        m_locked = true;
+        return;
+    }
+    // 被唤醒时锁已经交过来了
+    m_waiters.wait(lock);
+}
+
+bool FiberMutex::tryLock() {
+    SpinLock::Lock lock(m_mutex);
+    if(m_locked) {
+        return false;
+    }
+    m_locked = true;
+    return true;
+}
+
+void FiberMutex::unlock() {
+    FiberWaiter waiter;
+    {
+        SpinLock::Lock lock(m_mutex);
+        ORANGE_ASSERT(m_locked);
+        if(!m_waiters.pop(waiter)) {
+            m_locked = false;
+            return;
+        }
+    }
+    waiter.wake();
+}
+
+void FiberCondVar::wait(FiberMutex& mutex) {
+    SpinLock::Lock lock(m_mutex);
+    // 先排队再释放用户的锁，中间的notify不会丢
+    m_waiters.wait(lock, [&mutex]() {
+        mutex.unlock();
+    });
+    mutex.lock();
+}
+
+void FiberCondVar::notifyOne() {
+    FiberWaiter waiter;
+    {
+        SpinLock::Lock lock(m_mutex);
+        if(!m_waiters.pop(waiter)) {
+            return;
+        }
+    }
+    waiter.wake();
+}
+
+void FiberCondVar::notifyAll() {
+    std::deque<FiberWaiter> waiters;
+    {
+        SpinLock::Lock lock(m_mutex);
+        m_waiters.popAll(waiters);
+    }
+    for(auto& i : waiters) {
+        i.wake();
+    }
+}
+
+FiberSemaphore::FiberSemaphore(uint32_t count)
+    :m_count(count) {
+}
+
+void FiberSemaphore::wait() {
+    SpinLock::Lock lock(m_mutex);
+    if(m_count > 0) {
+        --m_count;
+        return;
+    }
+    m_waiters.wait(lock);
+}
+
+bool FiberSemaphore::tryWait() {
+    SpinLock::Lock lock(m_mutex);
+    if(m_count > 0) {
+        --m_count;
+        return true;
+    }
+    return false;
+}
+
+void FiberSemaphore::notify() {
+    FiberWaiter waiter;
+    {
+        SpinLock::Lock lock(m_mutex);
+        if(!m_waiters.pop(waiter)) {
+            ++m_count;
+            return;
+        }
+    }
+    waiter.wake();
+}
+
+void FiberWaitGroup::add(int32_t delta) {
+    std::deque<FiberWaiter> waiters;
+    {
+        SpinLock::Lock lock(m_mutex);
+        m_count += delta;
+        ORANGE_ASSERT(m_count >= 0);
+        if(m_count > 0) {
+            return;
+        }
+        m_waiters.popAll(waiters);
+    }
+    for(auto& i : waiters) {
+        i.wake();
+    }
+}
+
+void FiberWaitGroup::wait() {
+    SpinLock::Lock lock(m_mutex);
+    if(m_count == 0) {
+        return;
+    }
+    m_waiters.wait(lock);
+}
+
+} // namespace orange
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <deque>
+
+#include "fiber.h"
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace orange {
+
+class Scheduler;
+
+/*
+* 协程级的同步原语：等待时挂起当前协程，由唤醒方通过Scheduler把它放回原来的调度器，
+* 工作线程可以继续跑其他协程。不在调度器协程里(普通线程)时退化为用信号量阻塞线程
+*/
+
+// 等待者放在队列里(堆上)，不放在协程栈上：共享栈协程挂起后栈会被换出
+struct FiberWaiter {
+    Scheduler* scheduler = nullptr;
+    Fiber::ptr fiber;
+    // 不在协程里时阻塞线程用，在线程自己的栈上
+    Semaphore* sem = nullptr;
+
+    // 填写当前协程(或线程)，返回是否在调度器协程里
+    bool init(Semaphore* thread_sem);
+    void wake();
+};
+
+// 等待队列本身不加锁，由使用者的锁保护
+class FiberWaitQueue : Noncopyable {
+public:
+    /*
+    * 当前协程排队并挂起。调用时持有lock，挂起前释放，返回时不持有
+    * before_park在释放lock之后、挂起之前执行(条件变量在这里释放用户的锁)
+    */
+    template<class LockType, class BeforePark>
+    void wait(LockType& lock, BeforePark before_park) {
+        Semaphore sem;
+        FiberWaiter waiter;
+        bool in_fiber = waiter.init(&sem);
+        m_waiters.push_back(std::move(waiter));
+        lock.unlock();
+        before_park();
+        if(in_fiber) {
+            Fiber::YielToHold();
+        } else {
+            sem.wait();
+        }
+    }
+
+    template<class LockType>
+    void wait(LockType& lock) {
+        wait(lock, []() {});
+    }
+
+    // 取出最早的等待者，释放锁之后再wake
+    bool pop(FiberWaiter& waiter);
+    void popAll(std::deque<FiberWaiter>& waiters);
+    bool empty() const { return m_waiters.empty(); }
+    size_t size() const { return m_waiters.size(); }
+
+private:
+    std::deque<FiberWaiter> m_waiters;
+};
+
+// 协程互斥锁，unlock时直接把锁交给最早的等待者
+class FiberMutex : Noncopyable {
+public:
+    typedef ScopedLockImpl<FiberMutex> Lock;
+
+    void lock();
+    bool tryLock();
+    void unlock();
+
+private:
+    SpinLock m_mutex;
+    bool m_locked = false;
+    FiberWaitQueue m_waiters;
+};
+
+// 协程条件变量，配合FiberMutex使用
+class FiberCondVar : Noncopyable {
+public:
+    // 调用时持有mutex，返回时重新持有
+    void wait(FiberMutex& mutex);
+
+    template<class Predicate>
+    void wait(FiberMutex& mutex, Predicate pred) {
+        while(!pred()) {
+            wait(mutex);
+        }
+    }
+
+    void notifyOne();
+    void notifyAll();
+
+private:
+    SpinLock m_mutex;
+    FiberWaitQueue m_waiters;
+};
+
+// 协程信号量，notify时有等待者直接交给它
+class FiberSemaphore : Noncopyable {
+public:
+    FiberSemaphore(uint32_t count = 0);
+
+    void wait();
+    bool tryWait();
+    void notify();
+
+private:
+    SpinLock m_mutex;
+    uint32_t m_count;
+    FiberWaitQueue m_waiters;
+};
+
+// 等待一组任务完成：add(n)后每个任务done()一次，wait()等到计数归零
+class FiberWaitGroup : Noncopyable {
+public:
+    void add(int32_t delta = 1);
+    void done() { add(-1); }
+    void wait();
+
+private:
+    SpinLock m_mutex;
+    int32_t m_count = 0;
+    FiberWaitQueue m_waiters;
+};
+
+} // namespace orange
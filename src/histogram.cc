@@ -0,0 +1,72 @@
+#include "histogram.h"
+
+#include <sstream>
+
+namespace orange {
+
+Histogram::Histogram() {
+    reset();
+}
+
+int Histogram::Bucket(uint64_t value) {
+    return value ? 64 - __builtin_clzll(value) : 0;
+}
+
+uint64_t Histogram::BucketUpper(int idx) {
+    if(idx >= 64) {
+        return ~0ull;
+    }
+    return 1ull << idx;
+}
+
+void Histogram::add(uint64_t value) {
+    m_buckets[Bucket(value)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Histogram::reset() {
+    for(int i = 0; i < BUCKETS; ++i) {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t Histogram::getCount() const {
+    uint64_t count = 0;
+    for(int i = 0; i < BUCKETS; ++i) {
+        count += m_buckets[i].load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+uint64_t Histogram::percentile(double p) const {
+    uint64_t count = getCount();
+    if(!count) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(count * p);
+    if(target >= count) {
+        target = count - 1;
+    }
+    uint64_t seen = 0;
+    for(int i = 0; i < BUCKETS; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if(seen > target) {
+            return BucketUpper(i);
+        }
+    }
+    return BucketUpper(BUCKETS - 1);
+}
+
+std::string Histogram::toString() const {
+    std::stringstream ss;
+    for(int i = 0; i < BUCKETS; ++i) {
+        uint64_t n = m_buckets[i].load(std::memory_order_relaxed);
+        if(!n) {
+            continue;
+        }
+        uint64_t lower = i ? BucketUpper(i - 1) : 0;
+        ss << "[" << lower << "," << BucketUpper(i) << "):" << n << " ";
+    }
+    return ss.str();
+}
+
+} // namespace orange
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+namespace orange {
+
+/*
+* 按2的幂分桶的计数直方图，可以多线程同时add
+* 第0个桶记录0，第i个桶记录[2^(i-1), 2^i)
+*/
+class Histogram {
+public:
+    static const int BUCKETS = 65;
+
+    Histogram();
+
+    void add(uint64_t value);
+    void reset();
+
+    uint64_t getCount() const;
+    uint64_t getBucket(int idx) const { return m_buckets[idx]; }
+    // 近似分位数(0~1)，返回所在桶的上界
+    uint64_t percentile(double p) const;
+    // 只输出非空的桶，格式"[lo,hi):count"
+    std::string toString() const;
+
+    // value所在桶的下标
+    static int Bucket(uint64_t value);
+    // 第idx个桶的上界(不含)
+    static uint64_t BucketUpper(int idx);
+
+private:
+    std::atomic<uint64_t> m_buckets[BUCKETS];
+};
+
+} // namespace orange
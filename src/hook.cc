@@ -1,8 +1,15 @@
 #include "hook.h"
 
 #include <dlfcn.h>
+#include <limits.h>
+#include <linux/io_uring.h>
 #include <stdarg.h>
+#include <string.h>
 
+#include <algorithm>
+#include <type_traits>
+
+#include "blocking_pool.h"
 #include "config.h"
 #include "fd_manager.h"
 #include "log.h"
@@ -34,6 +41,11 @@ static orange::ConfigVar<int>::ptr s_tcp_connect_timeout =
     XX(send) \
     XX(sendto) \
     XX(sendmsg) \
+    XX(open) \
+    XX(fsync) \
+    XX(sendfile) \
+    XX(splice) \
+    XX(copy_file_range) \
     XX(close) \
     XX(fcntl) \
     XX(ioctl) \
@@ -81,13 +93,97 @@ void set_hook_enable(bool flag) {
 } // namespace orange
 
 
-struct time_info {
-    int cancelled = 0;
-};
+/*
+* 协程挂起前设置超时定时器，超时状态记在FdCtx里，不需要每次调用分配
+* 定时器回调持有ctx，和本次等待的序号对不上时什么都不做
+*/
+static orange::Timer::ptr arm_timeout(orange::IOManager* iom, const orange::FdCtx::ptr& ctx
+        , int timeout_so, uint32_t event, uint64_t to, uint64_t& seq) {
+    if((uint64_t)-1 == to) {
+        return nullptr;
+    }
+    seq = ctx->beginWait(timeout_so);
+    return iom->addTimer(to, [ctx, iom, timeout_so, event, seq]() {
+        if(ctx->markTimedOut(timeout_so, seq)) {
+            iom->cancelEvent(ctx->getFd(), (orange::IOManager::Event)event); //强制触发
+        }
+    });
+}
+
+/*
+* io_uring后端: 操作本身作为sqe提交，完成时直接拿到结果
+* 返回false表示没有走io_uring，调用方退回epoll路径
+*/
+static bool do_uring_io(orange::IOManager* iom, const io_uring_sqe& sqe,
+        uint64_t to, ssize_t& n) {
+    // 没有超时的请求只有当前协程引用，直接放在栈上
+    orange::IOManager::IoRequest local;
+    std::shared_ptr<orange::IOManager::IoRequest> holder;
+    orange::IOManager::IoRequest* req = &local;
+    if((uint64_t)-1 != to) {
+        holder.reset(new orange::IOManager::IoRequest);
+        req = holder.get();
+    }
+    if(!iom->submitIo(req, sqe)) {
+        return false;
+    }
 
-template<typename OringeFun, typename... Args>
+    orange::Timer::ptr timer;
+    if(holder) {
+        std::weak_ptr<orange::IOManager::IoRequest> wreq(holder);
+        timer = iom->addConditionTimer(to, [wreq, iom]() {
+            auto r = wreq.lock();
+            if(!r || r->cancelled) {
+                return;
+            }
+            r->cancelled = ETIMEDOUT;
+            iom->cancelIo(r.get());
+        }, wreq);
+    }
+
+    // 无论成功、超时还是取消，都要等到cqe回来才能返回，内核一直在使用req和缓冲区
+    orange::Fiber::YielToHold();
+    if(timer) {
+        timer->cancel();
+    }
+
+    if(-EAGAIN == req->res && !req->cancelled) {
+        // 老内核对非阻塞fd不会挂起等待
+        return false;
+    }
+    if(req->res < 0) {
+        if(-ECANCELED == req->res) {
+            // 超时，或者fd被其他协程关闭(和epoll路径一样返回EBADF)
+            errno = req->cancelled ? req->cancelled : EBADF;
+        } else {
+            errno = -req->res;
+        }
+        n = -1;
+    } else {
+        n = req->res;
+    }
+    return true;
+}
+
+// 共享栈协程挂起后栈会被换出，内核不能直接读写它栈上的缓冲区
+static orange::IOManager* uring_iomanager() {
+    orange::IOManager* iom = orange::IOManager::GetThis();
+    if(!iom || !iom->isUring() || orange::Fiber::GetThis()->isSharedStack()) {
+        return nullptr;
+    }
+    return iom;
+}
+
+static uint32_t uring_len(size_t len) {
+    return (uint32_t)std::min(len, (size_t)INT_MAX);
+}
+
+/*
+* prep为nullptr时只走epoll路径，否则io_uring后端下由prep填写sqe(fd已经填好)
+*/
+template<typename OringeFun, typename Prep, typename... Args>
 static ssize_t do_io(int fd, OringeFun fun, const char* hook_fun_name,
-        uint32_t event, int timeout_so, Args... args) {
+        uint32_t event, int timeout_so, Prep prep, Args... args) {
     if(!orange::t_hook_enable) {
         return fun(fd, std::forward<Args>(args)...);
     }
@@ -103,12 +199,37 @@ static ssize_t do_io(int fd, OringeFun fun, const char* hook_fun_name,
         return -1;
     }
 
+    // 普通文件没法用epoll等待，交给阻塞线程池
+    if(ctx->isFile() && orange::BlockingPool::CanOffload()) {
+        ssize_t n = -1;
+        int err = 0;
+        orange::BlockingPoolMgr::GetInstance()->run([&]() {
+            n = fun(fd, args...);
+            err = errno;
+        });
+        errno = err;
+        return n;
+    }
+
     if(!ctx->isSocket() || ctx->getUserNonblock()) {
         return fun(fd, std::forward<Args>(args)...);
     }
 
     uint64_t to = ctx->getTimeout(timeout_so);
-    std::shared_ptr<time_info> tinfo(new time_info);
+
+    if constexpr(!std::is_same<Prep, std::nullptr_t>::value) {
+        orange::IOManager* iom = uring_iomanager();
+        if(iom) {
+            io_uring_sqe sqe;
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.fd = fd;
+            prep(sqe);
+            ssize_t n = -1;
+            if(do_uring_io(iom, sqe, to, n)) {
+                return n;
+            }
+        }
+    }
 
 retry:
     ssize_t n = fun(fd, std::forward<Args>(args)...);
@@ -119,34 +240,19 @@ retry:
         errno = 0;
 
         orange::IOManager* iom = orange::IOManager::GetThis();
-        orange::Timer::ptr timer;
-
-        /*
-        * 可能io触发，提前执行当前协程，tinfo销毁
-        */
-        std::weak_ptr<time_info> winfo(tinfo);
-        if((uint64_t)-1 != to) {
-            timer = iom->addConditionTimer(to, [fd, winfo, iom, event]() {
-                auto t = winfo.lock();
-                if(!t || t->cancelled) {
-                    return;
-                }
-
-                t->cancelled = ETIMEDOUT;
-                iom->cancelEvent(fd, (orange::IOManager::Event)event); //强制触发
-            }, winfo);
-        }
-
         // cb = nullptr，FdContext::EventContext.fiber=当前线程
         int rt = iom->addEvent(fd, (orange::IOManager::Event)(event));
         if(-1 == rt) {
             ORANGE_LOG_ERROR(g_logger) << hook_fun_name << " addEvent("
                     << fd << ", " << event << ")";
-            if(timer) {
-                timer->cancel();
-            }
             return -1;
+        } else if(1 == rt) {
+            // 缓存的就绪状态表明数据已经到了，直接重试
+            goto retry;
         } else {
+            // 确定要挂起才设置超时
+            uint64_t seq = 0;
+            orange::Timer::ptr timer = arm_timeout(iom, ctx, timeout_so, event, to, seq);
             orange::Fiber::YielToHold();
 
             // 1、addEvent数据回来触发
@@ -154,10 +260,14 @@ retry:
 
             if(timer) {
                 timer->cancel();
+                if(ctx->isTimedOut(timeout_so, seq)) {
+                    errno = ETIMEDOUT;
+                    return -1;
+                }
             }
-
-            if(tinfo->cancelled) {
-                errno = tinfo->cancelled;
+            // 被close唤醒，fd还没真正关闭，重试会再次挂起且不会再被唤醒
+            if(ctx->isClose()) {
+                errno = EBADF;
                 return -1;
             }
 
@@ -249,7 +359,21 @@ int connect_with_timeout(int sockfd, const struct sockaddr *addr,
         return connect_f(sockfd, addr, addrlen);
     }
 
-    int n = connect_f(sockfd, addr, addrlen);
+    int n = 0;
+    orange::IOManager* uring = uring_iomanager();
+    ssize_t uring_n = -1;
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_CONNECT;
+    sqe.fd = sockfd;
+    sqe.addr = (uint64_t)addr;
+    sqe.off = addrlen;
+    if(uring && do_uring_io(uring, sqe, timeout_ms, uring_n)) {
+        // 内核返回EINPROGRESS时和普通connect一样等待可写
+        n = (int)uring_n;
+    } else {
+        n = connect_f(sockfd, addr, addrlen);
+    }
     if(0 == n) {
         return 0;
     } else if(-1 != n || errno != EINPROGRESS) {
@@ -257,41 +381,26 @@ int connect_with_timeout(int sockfd, const struct sockaddr *addr,
     }
 
     orange::IOManager* iom = orange::IOManager::GetThis();
-    orange::Timer::ptr timer;
-    std::shared_ptr<time_info> tinfo(new time_info);
-    std::weak_ptr<time_info> winfo(tinfo);
-
-    if((uint64_t)-1 != timeout_ms) {
-        timer = iom->addConditionTimer(timeout_ms, [sockfd, iom, winfo]() {
-            auto t = winfo.lock();
-            if(!t || t->cancelled) {
-                return;
-            }
-            t->cancelled = ETIMEDOUT;
-            iom->cancelEvent(sockfd, orange::IOManager::WRITE);
-        }, winfo);
-    }
-
     int rt = iom->addEvent(sockfd, orange::IOManager::WRITE);
     
     if(-1 == rt) {
         ORANGE_LOG_ERROR(g_logger) << "addEvent(" << sockfd << ", "
                 << orange::IOManager::WRITE << ")";
-        if(timer) {
-            timer->cancel();
-        }
-    } else {
+    } else if(0 == rt) {
+        uint64_t seq = 0;
+        orange::Timer::ptr timer = arm_timeout(iom, ctx, SO_SNDTIMEO
+                , orange::IOManager::WRITE, timeout_ms, seq);
         orange::Fiber::YielToHold();
 
         if(timer) {
             timer->cancel();
-        }
-
-        if(tinfo->cancelled) {
-            errno = tinfo->cancelled;
-            return -1;
+            if(ctx->isTimedOut(SO_SNDTIMEO, seq)) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
         }
     }
+    // rt为1时已经可写，连接结果直接从SO_ERROR取
 
     int error = 0;
     socklen_t len = sizeof(int);
@@ -317,7 +426,12 @@ int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
     if(!orange::t_hook_enable) {
         return accept_f(sockfd, addr, addrlen);
     }
-    int fd = do_io(sockfd, accept_f, "accept", orange::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+    int fd = do_io(sockfd, accept_f, "accept", orange::IOManager::READ, SO_RCVTIMEO,
+            [addr, addrlen](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_ACCEPT;
+                sqe.addr = (uint64_t)addr;
+                sqe.off = (uint64_t)addrlen;
+            }, addr, addrlen);
     if(fd >= 0) {
         orange::FdMrg::GetInstance()->get(fd, true);
     }
@@ -325,42 +439,167 @@ int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
 }
 
 ssize_t read(int fd, void *buf, size_t count) {
-    return do_io(fd, read_f, "read", orange::IOManager::READ, SO_RCVTIMEO, buf, count);
+    return do_io(fd, read_f, "read", orange::IOManager::READ, SO_RCVTIMEO,
+            [buf, count](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_RECV;
+                sqe.addr = (uint64_t)buf;
+                sqe.len = uring_len(count);
+            }, buf, count);
 }
 
 ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
-    return do_io(fd, readv_f, "readv", orange::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);
+    return do_io(fd, readv_f, "readv", orange::IOManager::READ, SO_RCVTIMEO,
+            [iov, iovcnt](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_READV;
+                sqe.addr = (uint64_t)iov;
+                sqe.len = iovcnt;
+                sqe.off = (uint64_t)-1;
+            }, iov, iovcnt);
 }
 
 ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
-    return do_io(sockfd, recv_f, "recv", orange::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
+    return do_io(sockfd, recv_f, "recv", orange::IOManager::READ, SO_RCVTIMEO,
+            [buf, len, flags](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_RECV;
+                sqe.addr = (uint64_t)buf;
+                sqe.len = uring_len(len);
+                sqe.msg_flags = flags;
+            }, buf, len, flags);
 }
 
 ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen) {
-    return do_io(sockfd, recvfrom_f, "recvfrom", orange::IOManager::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);
+    return do_io(sockfd, recvfrom_f, "recvfrom", orange::IOManager::READ, SO_RCVTIMEO,
+            nullptr, buf, len, flags, src_addr, addrlen);
 }
 ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
-    return do_io(sockfd, recvmsg_f, "recvmsg", orange::IOManager::READ, SO_RCVTIMEO, msg, flags);
+    return do_io(sockfd, recvmsg_f, "recvmsg", orange::IOManager::READ, SO_RCVTIMEO,
+            [msg, flags](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_RECVMSG;
+                sqe.addr = (uint64_t)msg;
+                sqe.msg_flags = flags;
+            }, msg, flags);
 }
 
 ssize_t write(int fd, const void *buf, size_t count) {
-    return do_io(fd, write_f, "write", orange::IOManager::WRITE, SO_SNDTIMEO, buf, count);
+    return do_io(fd, write_f, "write", orange::IOManager::WRITE, SO_SNDTIMEO,
+            [buf, count](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_SEND;
+                sqe.addr = (uint64_t)buf;
+                sqe.len = uring_len(count);
+            }, buf, count);
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
-    return do_io(fd, writev_f, "writev", orange::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);
+    return do_io(fd, writev_f, "writev", orange::IOManager::WRITE, SO_SNDTIMEO,
+            [iov, iovcnt](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_WRITEV;
+                sqe.addr = (uint64_t)iov;
+                sqe.len = iovcnt;
+                sqe.off = (uint64_t)-1;
+            }, iov, iovcnt);
 }
 
 ssize_t send(int sockfd, const void *buf, size_t len, int flags) {
-    return do_io(sockfd, send_f, "send", orange::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags);
+    return do_io(sockfd, send_f, "send", orange::IOManager::WRITE, SO_SNDTIMEO,
+            [buf, len, flags](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_SEND;
+                sqe.addr = (uint64_t)buf;
+                sqe.len = uring_len(len);
+                sqe.msg_flags = flags;
+            }, buf, len, flags);
 }
 
 ssize_t sendto(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen) {
-    return do_io(sockfd, sendto_f, "send", orange::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags, dest_addr, addrlen);
+    return do_io(sockfd, sendto_f, "send", orange::IOManager::WRITE, SO_SNDTIMEO,
+            nullptr, buf, len, flags, dest_addr, addrlen);
 }
 
 ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags) {
-    return do_io(sockfd, sendmsg_f, "sendmsg", orange::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
+    return do_io(sockfd, sendmsg_f, "sendmsg", orange::IOManager::WRITE, SO_SNDTIMEO,
+            [msg, flags](io_uring_sqe& sqe) {
+                sqe.opcode = IORING_OP_SENDMSG;
+                sqe.addr = (uint64_t)msg;
+                sqe.msg_flags = flags;
+            }, msg, flags);
+}
+
+int open(const char *pathname, int flags, ...) {
+    mode_t mode = 0;
+    if((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE) {
+        va_list va;
+        va_start(va, flags);
+        mode = va_arg(va, int);
+        va_end(va);
+    }
+    if(!orange::t_hook_enable || !orange::BlockingPool::CanOffload()) {
+        return open_f(pathname, flags, mode);
+    }
+    int fd = -1;
+    int err = 0;
+    orange::BlockingPoolMgr::GetInstance()->run([&]() {
+        fd = open_f(pathname, flags, mode);
+        err = errno;
+    });
+    if(fd >= 0) {
+        // 登记下来，之后的read/write才知道是普通文件
+        orange::FdMrg::GetInstance()->get(fd, true);
+    }
+    errno = err;
+    return fd;
+}
+
+int fsync(int fd) {
+    if(!orange::t_hook_enable || !orange::BlockingPool::CanOffload()) {
+        return fsync_f(fd);
+    }
+    int rt = -1;
+    int err = 0;
+    orange::BlockingPoolMgr::GetInstance()->run([&]() {
+        rt = fsync_f(fd);
+        err = errno;
+    });
+    errno = err;
+    return rt;
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    // 只有out_fd是socket时会EAGAIN，io_uring没有对应的操作
+    return do_io(out_fd, sendfile_f, "sendfile", orange::IOManager::WRITE, SO_SNDTIMEO,
+            nullptr, in_fd, offset, count);
+}
+
+/*
+* 一端必须是管道，在socket那一端等待
+* 带SPLICE_F_NONBLOCK时EAGAIN可能来自管道，按用户非阻塞处理，直接返回
+*/
+ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags) {
+    if(!orange::t_hook_enable || (flags & SPLICE_F_NONBLOCK)) {
+        return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+    }
+    orange::FdCtx::ptr ctx = orange::FdMrg::GetInstance()->get(fd_in);
+    if(ctx && ctx->isSocket()) {
+        return do_io(fd_in, splice_f, "splice", orange::IOManager::READ, SO_RCVTIMEO,
+                nullptr, off_in, fd_out, off_out, len, flags);
+    }
+    return do_io(fd_out, [fd_in, off_in](int fd, loff_t* off_out, size_t len, unsigned int flags) {
+                return splice_f(fd_in, off_in, fd, off_out, len, flags);
+            }, "splice", orange::IOManager::WRITE, SO_SNDTIMEO,
+            nullptr, off_out, len, flags);
+}
+
+// 两端都是普通文件，没法用epoll等待，和open/fsync一样交给阻塞线程池
+ssize_t copy_file_range(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags) {
+    if(!orange::t_hook_enable || !orange::BlockingPool::CanOffload()) {
+        return copy_file_range_f(fd_in, off_in, fd_out, off_out, len, flags);
+    }
+    ssize_t rt = -1;
+    int err = 0;
+    orange::BlockingPoolMgr::GetInstance()->run([&]() {
+        rt = copy_file_range_f(fd_in, off_in, fd_out, off_out, len, flags);
+        err = errno;
+    });
+    errno = err;
+    return rt;
 }
 
 int close(int fd) {
@@ -369,6 +608,8 @@ int close(int fd) {
     }
     orange::FdCtx::ptr ctx = orange::FdMrg::GetInstance()->get(fd);
     if(ctx) {
+        // 先标记关闭，再唤醒等待这个fd的协程
+        ctx->setClose();
         orange::IOManager* iom = orange::IOManager::GetThis();
         if(iom) {
             iom->cancelAllEvent(fd);
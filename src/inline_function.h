@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace orange {
+
+/*
+* 只支持void()的可调用对象，小于INLINE_SIZE的对象直接存放在内部缓冲区，
+* 不做堆分配；超出的退化为堆上存放
+*/
+class InlineFunction {
+public:
+    static const size_t INLINE_SIZE = 64;
+
+    InlineFunction() {}
+    InlineFunction(std::nullptr_t) {}
+
+    template<class F, class = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type, InlineFunction>::value>::type>
+    InlineFunction(F&& f) {
+        assign(std::forward<F>(f));
+    }
+
+    InlineFunction(InlineFunction&& oth) {
+        moveFrom(oth);
+    }
+
+    InlineFunction& operator=(InlineFunction&& oth) {
+        if(this != &oth) {
+            reset();
+            moveFrom(oth);
+        }
+        return *this;
+    }
+
+    InlineFunction& operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+
+    InlineFunction(const InlineFunction&) = delete;
+    InlineFunction& operator=(const InlineFunction&) = delete;
+
+    ~InlineFunction() {
+        reset();
+    }
+
+    void operator()() {
+        m_ops->invoke(m_buf);
+    }
+
+    explicit operator bool() const { return m_ops != nullptr; }
+
+    void reset() {
+        if(m_ops) {
+            m_ops->destroy(m_buf);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* buf);
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void* buf);
+    };
+
+    template<class F>
+    struct InlineOps {
+        static void Invoke(void* buf) {
+            (*(F*)buf)();
+        }
+        static void Move(void* dst, void* src) {
+            new (dst) F(std::move(*(F*)src));
+            ((F*)src)->~F();
+        }
+        static void Destroy(void* buf) {
+            ((F*)buf)->~F();
+        }
+        static const Ops s_ops;
+    };
+
+    template<class F>
+    struct HeapOps {
+        static void Invoke(void* buf) {
+            (**(F**)buf)();
+        }
+        static void Move(void* dst, void* src) {
+            *(F**)dst = *(F**)src;
+        }
+        static void Destroy(void* buf) {
+            delete *(F**)buf;
+        }
+        static const Ops s_ops;
+    };
+
+    template<class F>
+    void assign(F&& f) {
+        typedef typename std::decay<F>::type Fn;
+        // 空的std::function、空函数指针当作没有回调
+        if constexpr(std::is_pointer<Fn>::value
+                || std::is_constructible<bool, Fn>::value) {
+            if(!f) {
+                return;
+            }
+        }
+        if constexpr(sizeof(Fn) <= INLINE_SIZE
+                && alignof(Fn) <= alignof(std::max_align_t)
+                && std::is_nothrow_move_constructible<Fn>::value) {
+            new (m_buf) Fn(std::forward<F>(f));
+            m_ops = &InlineOps<Fn>::s_ops;
+        } else {
+            *(Fn**)m_buf = new Fn(std::forward<F>(f));
+            m_ops = &HeapOps<Fn>::s_ops;
+        }
+    }
+
+    void moveFrom(InlineFunction& oth) {
+        if(oth.m_ops) {
+            oth.m_ops->move(m_buf, oth.m_buf);
+            m_ops = oth.m_ops;
+            oth.m_ops = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) char m_buf[INLINE_SIZE];
+    const Ops* m_ops = nullptr;
+};
+
+template<class F>
+const InlineFunction::Ops InlineFunction::InlineOps<F>::s_ops = {
+    &InlineFunction::InlineOps<F>::Invoke,
+    &InlineFunction::InlineOps<F>::Move,
+    &InlineFunction::InlineOps<F>::Destroy
+};
+
+template<class F>
+const InlineFunction::Ops InlineFunction::HeapOps<F>::s_ops = {
+    &InlineFunction::HeapOps<F>::Invoke,
+    &InlineFunction::HeapOps<F>::Move,
+    &InlineFunction::HeapOps<F>::Destroy
+};
+
+} // namespace orange
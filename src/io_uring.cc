@@ -0,0 +1,153 @@
+#include "io_uring.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+
+namespace orange {
+
+static orange::Logger::ptr g_logger = ORANGE_LOG_NAME("system");
+
+static int sys_io_uring_setup(uint32_t entries, io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete
+        , uint32_t flags, void* arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete
+            , flags, arg, argsz);
+}
+
+IoUring::ptr IoUring::Create(uint32_t entries) {
+    IoUring::ptr ring(new IoUring);
+    if(!ring->init(entries)) {
+        return nullptr;
+    }
+    return ring;
+}
+
+bool IoUring::init(uint32_t entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    m_fd = sys_io_uring_setup(entries, &params);
+    if(m_fd < 0) {
+        ORANGE_LOG_ERROR(g_logger) << "io_uring_setup(" << entries << ") errno="
+            << errno << " " << strerror(errno);
+        return false;
+    }
+
+    // 需要超时等待(5.11)，并且CQ溢出时不丢事件
+    uint32_t need = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if((params.features & need) != need) {
+        ORANGE_LOG_ERROR(g_logger) << "io_uring features=" << params.features
+            << " missing=" << (need & ~params.features);
+        return false;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    m_ringSize = sq_size > cq_size ? sq_size : cq_size;
+    m_ringPtr = mmap(nullptr, m_ringSize, PROT_READ | PROT_WRITE
+            , MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if(m_ringPtr == MAP_FAILED) {
+        m_ringPtr = nullptr;
+        ORANGE_LOG_ERROR(g_logger) << "io_uring mmap ring errno=" << errno;
+        return false;
+    }
+
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE
+            , MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED) {
+        ORANGE_LOG_ERROR(g_logger) << "io_uring mmap sqes errno=" << errno;
+        return false;
+    }
+    m_sqes = (io_uring_sqe*)sqes;
+
+    char* ptr = (char*)m_ringPtr;
+    m_sqHead = (std::atomic<uint32_t>*)(ptr + params.sq_off.head);
+    m_sqTail = (std::atomic<uint32_t>*)(ptr + params.sq_off.tail);
+    m_sqArray = (uint32_t*)(ptr + params.sq_off.array);
+    m_sqMask = *(uint32_t*)(ptr + params.sq_off.ring_mask);
+    m_sqEntries = params.sq_entries;
+
+    m_cqHead = (std::atomic<uint32_t>*)(ptr + params.cq_off.head);
+    m_cqTail = (std::atomic<uint32_t>*)(ptr + params.cq_off.tail);
+    m_cqes = (io_uring_cqe*)(ptr + params.cq_off.cqes);
+    m_cqMask = *(uint32_t*)(ptr + params.cq_off.ring_mask);
+    return true;
+}
+
+IoUring::~IoUring() {
+    if(m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+    }
+    if(m_ringPtr) {
+        munmap(m_ringPtr, m_ringSize);
+    }
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool IoUring::push(const io_uring_sqe& sqe) {
+    uint32_t tail = m_sqTail->load(std::memory_order_relaxed);
+    uint32_t head = m_sqHead->load(std::memory_order_acquire);
+    if(tail - head >= m_sqEntries) {
+        return false;
+    }
+    uint32_t idx = tail & m_sqMask;
+    m_sqes[idx] = sqe;
+    m_sqArray[idx] = idx;
+    m_sqTail->store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+uint32_t IoUring::getUnsubmitted() const {
+    return m_sqTail->load(std::memory_order_relaxed)
+        - m_sqHead->load(std::memory_order_acquire);
+}
+
+int IoUring::submit(uint32_t wait_nr, int timeout_ms) {
+    uint32_t to_submit = getUnsubmitted();
+    if(!to_submit && !wait_nr) {
+        return 0;
+    }
+    uint32_t flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if(wait_nr) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if(timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+            arg.ts = (uint64_t)&ts;
+        }
+        arg.sigmask_sz = _NSIG / 8;
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    int rt = 0;
+    do {
+        rt = sys_io_uring_enter(m_fd, to_submit, wait_nr, flags
+                , wait_nr ? &arg : nullptr, wait_nr ? sizeof(arg) : 0);
+    } while(rt < 0 && errno == EINTR && !wait_nr);
+    if(rt < 0) {
+        if(errno == ETIME || errno == EINTR) {
+            return 0;
+        }
+        ORANGE_LOG_ERROR(g_logger) << "io_uring_enter(" << m_fd << ", " << to_submit
+            << ", " << wait_nr << ") errno=" << errno << " " << strerror(errno);
+        return -1;
+    }
+    return rt;
+}
+
+} // namespace orange
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+#include "noncopyable.h"
+
+namespace orange {
+
+/*
+* 直接使用系统调用的io_uring封装，不依赖liburing
+* push需要调用方保证同一时刻只有一个线程，reap同样只能有一个线程，
+* submit可以并发调用
+*/
+class IoUring : Noncopyable {
+public:
+    typedef std::shared_ptr<IoUring> ptr;
+
+    // 内核不支持或者缺少需要的特性时返回nullptr
+    static IoUring::ptr Create(uint32_t entries);
+    ~IoUring();
+
+    int getFd() const { return m_fd; }
+    uint32_t getSqEntries() const { return m_sqEntries; }
+
+    // 拷贝到SQ并发布给内核，SQ满时返回false
+    bool push(const io_uring_sqe& sqe);
+    // 已经放入SQ还没被内核取走的数量
+    uint32_t getUnsubmitted() const;
+
+    /*
+    * 提交SQ中所有请求，wait_nr>0时等待完成事件，timeout_ms为-1时一直等待
+    * 返回提交的数量，超时或者被信号打断返回0，出错返回-1
+    */
+    int submit(uint32_t wait_nr = 0, int timeout_ms = -1);
+
+    // 依次处理已经完成的cqe，返回处理的数量
+    template<class F>
+    uint32_t reap(F f) {
+        uint32_t head = m_cqHead->load(std::memory_order_relaxed);
+        uint32_t tail = m_cqTail->load(std::memory_order_acquire);
+        uint32_t count = 0;
+        for(; head != tail; ++head, ++count) {
+            f(m_cqes[head & m_cqMask]);
+        }
+        m_cqHead->store(head, std::memory_order_release);
+        return count;
+    }
+
+private:
+    IoUring() {}
+    bool init(uint32_t entries);
+
+private:
+    int m_fd = -1;
+    void* m_ringPtr = nullptr;
+    size_t m_ringSize = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    std::atomic<uint32_t>* m_sqHead = nullptr;
+    std::atomic<uint32_t>* m_sqTail = nullptr;
+    uint32_t* m_sqArray = nullptr;
+    uint32_t m_sqMask = 0;
+    uint32_t m_sqEntries = 0;
+
+    std::atomic<uint32_t>* m_cqHead = nullptr;
+    std::atomic<uint32_t>* m_cqTail = nullptr;
+    io_uring_cqe* m_cqes = nullptr;
+    uint32_t m_cqMask = 0;
+};
+
+} // namespace orange
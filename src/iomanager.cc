@@ -2,10 +2,16 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
+#include <algorithm>
+
+#include "config.h"
+#include "io_uring.h"
 #include "log.h"
 #include "macro.h"
 
@@ -13,6 +19,56 @@ namespace orange {
 
 static orange::Logger::ptr g_logger = ORANGE_LOG_NAME("system");
 
+static orange::ConfigVar<bool>::ptr g_iomanager_register_once =
+    orange::Config::Lookup<bool>("iomanager.register_once", false
+            , "register each fd once with EPOLLIN|EPOLLOUT|EPOLLET and cache readiness");
+
+static orange::ConfigVar<std::string>::ptr g_iomanager_backend =
+    orange::Config::Lookup<std::string>("iomanager.backend", "epoll"
+            , "hooked socket io backend, epoll or io_uring");
+
+static orange::ConfigVar<uint32_t>::ptr g_iomanager_uring_entries =
+    orange::Config::Lookup<uint32_t>("iomanager.uring_entries", 4096, "io_uring sq entries");
+
+static orange::ConfigVar<uint32_t>::ptr g_iomanager_uring_batch =
+    orange::Config::Lookup<uint32_t>("iomanager.uring_batch", 32
+            , "submit io_uring sqes after this many are pending or this many tasks ran");
+
+static orange::ConfigVar<bool>::ptr g_iomanager_multi_reactor =
+    orange::Config::Lookup<bool>("iomanager.multi_reactor", false
+            , "one epoll per worker thread, each fd bound to one worker");
+
+static orange::ConfigVar<uint32_t>::ptr g_iomanager_epoll_batch_min =
+    orange::Config::Lookup<uint32_t>("iomanager.epoll_batch_min", 64
+            , "min events fetched by one epoll_wait");
+
+static orange::ConfigVar<uint32_t>::ptr g_iomanager_epoll_batch_max =
+    orange::Config::Lookup<uint32_t>("iomanager.epoll_batch_max", 4096
+            , "max events fetched by one epoll_wait, batch grows when epoll_wait fills it");
+
+static orange::ConfigVar<uint32_t>::ptr g_iomanager_event_budget_us =
+    orange::Config::Lookup<uint32_t>("iomanager.event_budget_us", 1000
+            , "max time(us) spent on ready events per loop, the rest are left to the next loop, 0 for unlimited");
+
+static orange::ConfigVar<uint32_t>::ptr g_iomanager_spin_us =
+    orange::Config::Lookup<uint32_t>("iomanager.spin_us", 0
+            , "idle thread polls epoll and run queues for this many us before blocking, 0 for off");
+
+static orange::ConfigVar<bool>::ptr g_iomanager_cached_clock =
+    orange::Config::Lookup<bool>("iomanager.cached_clock", false
+            , "timers and log timestamps use the time cached once per event loop iteration");
+
+// 连续多少次epoll_wait返回不到batch的1/4后缩小batch
+static const uint32_t s_shrink_rounds = 64;
+// 每处理多少个事件检查一次时间预算
+static const size_t s_budget_check = 16;
+
+// ring上epoll fd的POLL_ADD请求，取消请求的user_data为0
+static const uint64_t s_epoll_user_data = 1;
+
+// 本线程攒着未提交的请求后又执行了多少个任务
+static thread_local uint32_t t_uring_defer = 0;
+
 IOManager::FdContext::EventContext& IOManager::FdContext::getContext(IOManager::Event event) {
     switch (event) {
         case IOManager::Event::READ:
@@ -33,12 +89,18 @@ void IOManager::FdContext::resetContext(IOManager::FdContext::EventContext& ctx)
     ctx.cb = nullptr;
 }
 
-void IOManager::FdContext::triggerEvent(Event event) {
+void IOManager::FdContext::triggerEvent(Event event, ScheduleBatch* batch, int thread) {
     ORANGE_ASSERT(events & event);
 
     events = (Event)(events & (~event));
     EventContext& event_ctx = getContext(event);
-    if(event_ctx.cb) {
+    if(batch && batch->getScheduler() == event_ctx.scheduler) {
+        if(event_ctx.cb) {
+            batch->add(&event_ctx.cb, thread);
+        } else {
+            batch->add(&event_ctx.fiber, thread);
+        }
+    } else if(event_ctx.cb) {
         event_ctx.scheduler->schedule(&event_ctx.cb);
     } else {
         event_ctx.scheduler->schedule(&event_ctx.fiber);
@@ -49,6 +111,19 @@ void IOManager::FdContext::triggerEvent(Event event) {
 // IOManager
 IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
     : Scheduler(threads, use_caller,  name) {
+    m_registerOnce = g_iomanager_register_once->getValue();
+    m_eventsMin = std::max(g_iomanager_epoll_batch_min->getValue(), 1u);
+    m_eventsMax = std::max((size_t)g_iomanager_epoll_batch_max->getValue(), m_eventsMin);
+    m_eventBudgetUs = g_iomanager_event_budget_us->getValue();
+    m_spinUs = g_iomanager_spin_us->getValue();
+    m_cachedClock = g_iomanager_cached_clock->getValue();
+    if(g_iomanager_backend->getValue() == "io_uring") {
+        m_ring = IoUring::Create(g_iomanager_uring_entries->getValue());
+        if(!m_ring) {
+            ORANGE_LOG_ERROR(g_logger) << "io_uring unavailable, fall back to epoll";
+        }
+        m_uringBatch = std::max(g_iomanager_uring_batch->getValue(), 1u);
+    }
     m_epfd = epoll_create(5000);
     ORANGE_ASSERT(m_epfd > 0);
 
@@ -66,8 +141,32 @@ IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
     rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFd[0], &event);
     ORANGE_ASSERT(rt == 0);
 
-    contextResize(32);
-    
+    for(int i = 0; i < FD_MAX_PAGES; ++i) {
+        m_fdPages[i] = nullptr;
+    }
+
+    if(g_iomanager_multi_reactor->getValue()) {
+        if(m_ring) {
+            ORANGE_LOG_ERROR(g_logger) << "multi reactor is ignored with io_uring backend";
+        } else {
+            m_multiReactor = true;
+            size_t count = m_threadCount + (m_rootThread == -1 ? 0 : 1);
+            for(size_t i = 0; i < count; ++i) {
+                Reactor* reactor = new Reactor;
+                reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+                ORANGE_ASSERT(reactor->epfd >= 0);
+                reactor->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                ORANGE_ASSERT(reactor->wakeFd >= 0);
+                memset(&event, 0, sizeof(event));
+                event.data.fd = reactor->wakeFd;
+                event.events = EPOLLIN | EPOLLET;
+                rt = epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->wakeFd, &event);
+                ORANGE_ASSERT(rt == 0);
+                m_reactors.push_back(reactor);
+            }
+        }
+    }
+
     start();
 }
 
@@ -77,37 +176,87 @@ IOManager::~IOManager() {
     close(m_tickleFd[0]);
     close(m_tickleFd[1]);
 
-    for(size_t i = 0; i < m_fdContexts.size(); ++i) {
-        if(m_fdContexts[i]) {
-            delete m_fdContexts[i];
-            m_fdContexts[i] = nullptr;
-        }
+    for(int i = 0; i < FD_MAX_PAGES; ++i) {
+        delete[] m_fdPages[i].load(std::memory_order_relaxed);
+    }
+
+    for(auto reactor : m_reactors) {
+        close(reactor->epfd);
+        close(reactor->wakeFd);
+        delete reactor;
     }
 }
 
-void IOManager::contextResize(size_t size) {
-    m_fdContexts.resize(size);
+IOManager::FdContext* IOManager::getFdContext(int fd, bool auto_create) {
+    if(fd < 0 || fd >= FD_MAX_PAGES * FD_PAGE_SIZE) {
+        return nullptr;
+    }
+    std::atomic<FdContext*>& slot = m_fdPages[fd >> FD_PAGE_BITS];
+    FdContext* page = slot.load(std::memory_order_acquire);
+    if(!page) {
+        if(!auto_create) {
+            return nullptr;
+        }
+        FdContext* new_page = new FdContext[FD_PAGE_SIZE];
+        int base = fd & ~(FD_PAGE_SIZE - 1);
+        for(int i = 0; i < FD_PAGE_SIZE; ++i) {
+            new_page[i].fd = base + i;
+        }
+        // 多个线程同时创建时只有一个能发布成功
+        if(slot.compare_exchange_strong(page, new_page
+                    , std::memory_order_acq_rel, std::memory_order_acquire)) {
+            page = new_page;
+        } else {
+            delete[] new_page;
+        }
+    }
+    return &page[fd & (FD_PAGE_SIZE - 1)];
+}
 
-    for(size_t i = 0; i < m_fdContexts.size(); ++i) {
-        if(!m_fdContexts[i]) {
-            m_fdContexts[i] = new FdContext();
-            m_fdContexts[i]->fd = i;
+int IOManager::epollCtl(FdContext* fd_ctx, int op, uint32_t events) {
+    int epfd = m_epfd;
+    if(m_multiReactor) {
+        if(fd_ctx->reactor < 0) {
+            // 绑定到第一次等待它的工作线程，其他线程提交的轮流分配
+            fd_ctx->reactor = getReactor(orange::GetThreadId());
+            // 跳过还没有线程认领的reactor(例如还没进入调度的caller线程)
+            size_t count = m_reactors.size();
+            for(size_t i = 0; fd_ctx->reactor < 0 && i < count; ++i) {
+                uint32_t idx = m_nextReactor++ % count;
+                if(m_reactors[idx]->thread != -1) {
+                    fd_ctx->reactor = idx;
+                }
+            }
+            if(fd_ctx->reactor < 0) {
+                fd_ctx->reactor = m_nextReactor++ % count;
+            }
         }
+        epfd = m_reactors[fd_ctx->reactor]->epfd;
+    }
+
+    epoll_event epevent;
+    memset(&epevent, 0, sizeof(epevent));
+    epevent.data.ptr = fd_ctx;
+    epevent.events = events;
+    ++m_epollCtlCount;
+    int rt = epoll_ctl(epfd, op, fd_ctx->fd, &epevent);
+    if(rt) {
+        ORANGE_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+                    << op << ", " << fd_ctx->fd << ", " << events << "):"
+                    << rt << " (" << errno << ") (" << strerror(errno) << ")";
+    } else if(op == EPOLL_CTL_DEL) {
+        // 不再等待任何事件，fd号复用后重新绑定
+        fd_ctx->reactor = -1;
     }
+    return rt;
 }
 
-// 0 success, , -1 error
+// 0 success, 1 retry, -1 error
 int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
-    FdContext* fd_ctx = nullptr;
-    RWMutexType::ReadLock lock(m_mutex);
-    if(fd < (int)m_fdContexts.size()) {
-        fd_ctx = m_fdContexts[fd];
-        lock.unlock();
-    } else {
-        lock.unlock();
-        RWMutexType::WriteLock lock2(m_mutex);
-        contextResize(fd * 1.5);
-        fd_ctx = m_fdContexts[fd];
+    FdContext* fd_ctx = getFdContext(fd, true);
+    if(!fd_ctx) {
+        ORANGE_LOG_ERROR(g_logger) << "addEvent invalid fd=" << fd;
+        return -1;
     }
 
     FdContext::MutexType::Lock lock3(fd_ctx->mutex);
@@ -118,18 +267,28 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
         ORANGE_ASSERT(!(fd_ctx->events & event));
     }
 
-    int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
-    epoll_event epevent;
-    memset(&epevent, 0, sizeof(0));
-    // epevent.data.fd = fd;
-    epevent.data.ptr = fd_ctx;
-    epevent.events = EPOLLET | fd_ctx->events | event;
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        ORANGE_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                    << op << ", " << epevent.events << "):"
-                    << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return -1;
+    if(m_registerOnce) {
+        if(!fd_ctx->registered) {
+            // 加入时已经就绪的方向会马上上报一次边沿
+            if(epollCtl(fd_ctx, EPOLL_CTL_ADD, EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP)) {
+                return -1;
+            }
+            fd_ctx->registered = true;
+            fd_ctx->ready = NONE;
+        } else if(fd_ctx->ready & event) {
+            // 上次EAGAIN之后边沿已经到了，不需要等待
+            fd_ctx->ready &= ~event;
+            if(!cb) {
+                return 1;
+            }
+            schedule(&cb);
+            return 0;
+        }
+    } else {
+        int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if(epollCtl(fd_ctx, op, EPOLLET | fd_ctx->events | event)) {
+            return -1;
+        }
     }
     ++m_pendingEventCount;
     fd_ctx->events = (Event)(fd_ctx->events | event);
@@ -149,12 +308,10 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
 }
 
 bool IOManager::delEvent(int fd, Event event) {
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd) {
+    FdContext* fd_ctx = getFdContext(fd, false);
+    if(!fd_ctx) {
         return false;
     }
-    lock.unlock();
-    FdContext* fd_ctx = m_fdContexts[fd];
 
     MutexType::Lock lock2(fd_ctx->mutex);
     if(!(fd_ctx->events & event)) {
@@ -162,19 +319,11 @@ bool IOManager::delEvent(int fd, Event event) {
     }
 
     Event new_event = (Event)(fd_ctx->events & ~event);
-    int op = new_event ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-
-    epoll_event epevent;
-    memset(&epevent, 0, sizeof(epevent));
-    // epevent.data.fd = fd;
-    epevent.data.ptr = fd_ctx;
-    epevent.events = EPOLLET | new_event;
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        ORANGE_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                    << op << ", " << epevent.events << "):"
-                    << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false;
+    if(!m_registerOnce) {
+        int op = new_event ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        if(epollCtl(fd_ctx, op, EPOLLET | new_event)) {
+            return false;
+        }
     }
 
     --m_pendingEventCount;
@@ -185,29 +334,21 @@ bool IOManager::delEvent(int fd, Event event) {
 }
 
 bool IOManager::cancelEvent(int fd, Event event) {
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd) {
+    FdContext* fd_ctx = getFdContext(fd, false);
+    if(!fd_ctx) {
         return false;
     }
-    lock.unlock();
-    FdContext* fd_ctx = m_fdContexts[fd];
     MutexType::Lock lock2(fd_ctx->mutex);
     if(!(fd_ctx->events & event)) {
         return false;
     }
 
-    Event new_event = (Event)(fd_ctx->events & ~event);
-    int op = new_event ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event epevent;
-    memset(&epevent, 0, sizeof(epevent));
-    epevent.events = EPOLLET | new_event;
-    epevent.data.ptr = fd_ctx;
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        ORANGE_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                    << op << ", " << epevent.events << "):"
-                    << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false;
+    if(!m_registerOnce) {
+        Event new_event = (Event)(fd_ctx->events & ~event);
+        int op = new_event ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        if(epollCtl(fd_ctx, op, EPOLLET | new_event)) {
+            return false;
+        }
     }
 
     fd_ctx->triggerEvent(event);
@@ -216,29 +357,45 @@ bool IOManager::cancelEvent(int fd, Event event) {
 }
 
 bool IOManager::cancelAllEvent(int fd) {
-    RWMutexType::ReadLock lock(m_mutex);
-    if((int)m_fdContexts.size() <= fd) {
+    FdContext* fd_ctx = getFdContext(fd, false);
+    if(!fd_ctx) {
         return false;
     }
-    lock.unlock();
-    FdContext* fd_ctx = m_fdContexts[fd];
 
-    MutexType::Lock lock2(fd_ctx->mutex);
-    if(!fd_ctx->events) {
-        return false;
+    if(m_ring && fd_ctx->ioCount > 0) {
+        io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.fd = fd;
+        sqe.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        {
+            MutexType::Lock lock(m_ringMutex);
+            if(!m_ring->push(sqe)) {
+                m_ring->submit();
+                m_ring->push(sqe);
+            }
+        }
+        flushIo();
     }
 
-    int op = EPOLL_CTL_DEL;
-    epoll_event epevent;
-    memset(&epevent, 0, sizeof(epevent));
-    epevent.events = 0;
-    epevent.data.ptr = fd_ctx;
-    int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-    if(rt) {
-        ORANGE_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                    << op << ", " << epevent.events << "):"
-                    << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false;
+    MutexType::Lock lock2(fd_ctx->mutex);
+    if(m_registerOnce) {
+        // fd即将关闭或者不再由IOManager管理，下次addEvent重新注册
+        if(!fd_ctx->registered) {
+            return false;
+        }
+        fd_ctx->registered = false;
+        fd_ctx->ready = NONE;
+        if(epollCtl(fd_ctx, EPOLL_CTL_DEL, 0)) {
+            return false;
+        }
+    } else {
+        if(!fd_ctx->events) {
+            return false;
+        }
+        if(epollCtl(fd_ctx, EPOLL_CTL_DEL, 0)) {
+            return false;
+        }
     }
 
     if(fd_ctx->events & WRITE) {
@@ -255,6 +412,120 @@ bool IOManager::cancelAllEvent(int fd) {
     return true;
 }
 
+bool IOManager::submitIo(IoRequest* req, const io_uring_sqe& sqe) {
+    FdContext* fd_ctx = getFdContext(sqe.fd, true);
+    if(!m_ring || !fd_ctx) {
+        return false;
+    }
+    req->scheduler = Scheduler::GetThis();
+    req->fiber = Fiber::GetThis();
+    req->fd = sqe.fd;
+    io_uring_sqe tmp = sqe;
+    tmp.user_data = (uint64_t)req;
+
+    ++fd_ctx->ioCount;
+    ++m_pendingEventCount;
+    uint32_t unsubmitted = 0;
+    {
+        MutexType::Lock lock(m_ringMutex);
+        if(!m_ring->push(tmp)) {
+            // SQ满了先提交一次腾出位置
+            m_ring->submit();
+            if(!m_ring->push(tmp)) {
+                --fd_ctx->ioCount;
+                --m_pendingEventCount;
+                req->fiber.reset();
+                return false;
+            }
+        }
+        unsubmitted = m_ring->getUnsubmitted();
+    }
+    // 攒够一批立即提交，否则等本线程空闲或者再执行若干任务后提交
+    if(unsubmitted >= m_uringBatch) {
+        flushIo();
+    }
+    return true;
+}
+
+void IOManager::cancelIo(IoRequest* req) {
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_ASYNC_CANCEL;
+    sqe.fd = -1;
+    sqe.addr = (uint64_t)req;
+    {
+        MutexType::Lock lock(m_ringMutex);
+        if(!m_ring->push(sqe)) {
+            m_ring->submit();
+            m_ring->push(sqe);
+        }
+    }
+    flushIo();
+}
+
+void IOManager::flushIo() {
+    t_uring_defer = 0;
+    m_ring->submit();
+}
+
+void IOManager::onTaskDone() {
+    if(!m_ring || !m_ring->getUnsubmitted()) {
+        return;
+    }
+    // 一直有任务的线程不会进入idle，执行一定数量的任务后也要提交
+    if(++t_uring_defer >= m_uringBatch) {
+        flushIo();
+    }
+}
+
+void IOManager::armEpoll() {
+    if(m_epollArmed) {
+        return;
+    }
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_POLL_ADD;
+    sqe.fd = m_epfd;
+    sqe.poll32_events = POLLIN;
+    sqe.user_data = s_epoll_user_data;
+    MutexType::Lock lock(m_ringMutex);
+    if(!m_ring->push(sqe)) {
+        m_ring->submit();
+        if(!m_ring->push(sqe)) {
+            return;
+        }
+    }
+    m_epollArmed = true;
+}
+
+bool IOManager::reapIo(ScheduleBatch& batch) {
+    bool epoll_ready = false;
+    m_ring->reap([this, &batch, &epoll_ready](const io_uring_cqe& cqe) {
+        if(cqe.user_data == 0) {
+            return;
+        }
+        if(cqe.user_data == s_epoll_user_data) {
+            m_epollArmed = false;
+            epoll_ready = true;
+            return;
+        }
+        IoRequest* req = (IoRequest*)cqe.user_data;
+        req->res = cqe.res;
+        FdContext* fd_ctx = getFdContext(req->fd, false);
+        if(fd_ctx) {
+            --fd_ctx->ioCount;
+        }
+        --m_pendingEventCount;
+        // 放入batch后请求所在的协程随时可能返回，之后不能再访问req
+        if(req->scheduler == this) {
+            batch.add(&req->fiber);
+        } else {
+            req->scheduler->schedule(&req->fiber);
+        }
+    });
+    return epoll_ready;
+}
+
 IOManager* IOManager::GetThis() {
     return dynamic_cast<IOManager*>(Scheduler::GetThis());
 }
@@ -263,8 +534,139 @@ void IOManager::tickle() {
     if(!hasIdleThreads()) {
         return;
     }
+    if(m_multiReactor) {
+        size_t count = m_reactors.size();
+        uint32_t start = m_nextReactor++;
+        for(size_t i = 0; i < count; ++i) {
+            Reactor* reactor = m_reactors[(start + i) % count];
+            // 清掉标记，同一个忙等的线程只抵一次唤醒
+            if(reactor->spinning.exchange(false)) {
+                return;
+            }
+            if(reactor->idle && !reactor->tickled) {
+                wakeReactor(reactor);
+                return;
+            }
+        }
+        // 空闲线程都在进出idle的途中，留一个唤醒，下一次epoll_wait立即返回
+        wakeReactor(m_reactors[start % count]);
+        return;
+    }
+    MutexType::Lock lock(m_idleMutex);
+    if(m_leaderSpinning) {
+        m_leaderSpinning = false;
+        return;
+    }
+    if(!wakeFollower()) {
+        wakeLeader();
+    }
+}
+
+void IOManager::tickleThread(int thread) {
+    if(m_multiReactor) {
+        // 不在idle的线程会在进入epoll_wait前检查自己的inbox
+        int idx = getReactor(thread);
+        if(idx < 0) {
+            return;
+        }
+        // 忙等的线程清掉标记后不会再阻塞
+        if(m_reactors[idx]->spinning.exchange(false)) {
+            return;
+        }
+        if(m_reactors[idx]->idle) {
+            wakeReactor(m_reactors[idx]);
+        }
+        return;
+    }
+    MutexType::Lock lock(m_idleMutex);
+    if(m_hasLeader && m_leaderThread == thread) {
+        if(m_leaderSpinning) {
+            m_leaderSpinning = false;
+        } else {
+            wakeLeader();
+        }
+        return;
+    }
+    for(auto sleeper : m_parked) {
+        if(sleeper->thread == thread) {
+            wakeFollower(sleeper);
+            return;
+        }
+    }
+    // 目标线程正在执行任务，会自己检查inbox
+}
+
+bool IOManager::wakeFollower(Sleeper* sleeper) {
+    if(m_parked.empty()) {
+        return false;
+    }
+    if(sleeper) {
+        m_parked.erase(std::find(m_parked.begin(), m_parked.end(), sleeper));
+    } else {
+        // 后进先出，最近停下的线程缓存更热
+        sleeper = m_parked.back();
+        m_parked.pop_back();
+    }
+    sleeper->parked = false;
+    uint64_t one = 1;
+    int rt = ::write(sleeper->fd, &one, sizeof(one));
+    ORANGE_ASSERT(rt == sizeof(one));
+    ++m_wakeupCount;
+    return true;
+}
+
+void IOManager::wakeLeader() {
+    // 没有leader时也写入，下一个leader进入epoll_wait会立即返回
+    if(m_leaderTickled) {
+        return;
+    }
+    m_leaderTickled = true;
     int rt = ::write(m_tickleFd[1], "T", 1);
     ORANGE_ASSERT(rt == 1);
+    ++m_wakeupCount;
+}
+
+int IOManager::getReactor(int thread) {
+    for(size_t i = 0; i < m_reactors.size(); ++i) {
+        if(m_reactors[i]->thread == thread) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void IOManager::wakeReactor(Reactor* reactor) {
+    if(reactor->tickled.exchange(true)) {
+        return;
+    }
+    uint64_t one = 1;
+    int rt = ::write(reactor->wakeFd, &one, sizeof(one));
+    ORANGE_ASSERT(rt == sizeof(one));
+    ++m_wakeupCount;
+}
+
+void IOManager::park(Sleeper* sleeper, uint64_t timeout) {
+    static const int MAX_TIMEOUT = 3000;
+    pollfd pfd;
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.fd = sleeper->fd;
+    pfd.events = POLLIN;
+    int rt = 0;
+    do {
+        rt = poll(&pfd, 1, timeout > (uint64_t)MAX_TIMEOUT ? MAX_TIMEOUT : (int)timeout);
+    } while(rt < 0 && errno == EINTR);
+
+    {
+        MutexType::Lock lock(m_idleMutex);
+        if(sleeper->parked) {
+            // 超时返回，自己从等待列表中移除
+            m_parked.erase(std::find(m_parked.begin(), m_parked.end(), sleeper));
+            sleeper->parked = false;
+        }
+    }
+    // 唤醒方在锁内写入，这里一定能读到
+    uint64_t dummy;
+    while(::read(sleeper->fd, &dummy, sizeof(dummy)) == sizeof(dummy));
 }
 
 bool IOManager::stopping() {
@@ -281,22 +683,106 @@ bool IOManager::stopping(uint64_t& timeout) {
 
 void IOManager::idle() {
     ORANGE_LOG_INFO(g_logger) << "IOManager::idel()";
-    static const int MAX_EVENTS = 64;
-    epoll_event* events = new epoll_event[MAX_EVENTS]; // 栈内存较小
-    std::shared_ptr<epoll_event> shared_events(events, [](epoll_event* ptr) {
-        delete[] ptr;
-    });
+    if(m_multiReactor) {
+        reactorIdle();
+        return;
+    }
+    EventBuffer buf;
+    initEventBuffer(buf);
+    Sleeper sleeper;
+    sleeper.thread = orange::GetThreadId();
+    sleeper.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ORANGE_ASSERT(sleeper.fd >= 0);
 
     while(true) {
         uint64_t next_timeout = 0;
         if(stopping(next_timeout)) {
             ORANGE_LOG_INFO(g_logger) << "name: " << getName()
                 << ", idel stopping exit.";
+            DisableCachedClock();
+            // 最后一个定时器在本线程触发时，其他空闲线程还阻塞着，叫醒它们检查退出条件
+            MutexType::Lock lock(m_idleMutex);
+            while(wakeFollower());
+            wakeLeader();
             break;
         }
 
+        if(buf.hasPending()) {
+            // 上一轮没处理完的事件不再等待，和到期的定时器一起处理
+            uint64_t begin = loopClock();
+            ScheduleBatch batch(this);
+            listExpiredTimers(batch);
+            processEvents(buf, m_tickleFd[0], -1, batch);
+            batch.commit();
+            m_loopTime.add(orange::GetCurrentUS() - begin);
+
+            Fiber::ptr cur = Fiber::GetThis();
+            Fiber* fiber = cur.get();
+            cur.reset();
+            fiber->swapOut();
+            continue;
+        }
+
+        bool leader = false;
+        {
+            MutexType::Lock lock(m_idleMutex);
+            if(!m_hasLeader) {
+                m_hasLeader = true;
+                m_leaderThread = sleeper.thread;
+                leader = true;
+            } else {
+                sleeper.parked = true;
+                m_parked.push_back(&sleeper);
+            }
+        }
+        if(!leader) {
+            // 检查退出条件和登记之间，最后一个线程可能已经退出并唤醒过了，登记后再查一次
+            if(m_stopping && stopping()) {
+                MutexType::Lock lock(m_idleMutex);
+                if(sleeper.parked) {
+                    m_parked.erase(std::find(m_parked.begin(), m_parked.end(), &sleeper));
+                    sleeper.parked = false;
+                }
+                continue;
+            }
+            if(m_ring) {
+                flushIo();
+            }
+            // 只有leader等共享的定时器，follower只等自己的
+            park(&sleeper, getNextThreadTimer());
+            if(m_cachedClock) {
+                UpdateCachedClock();
+            }
+            {
+                ScheduleBatch batch(this);
+                listExpiredTimers(batch);
+            }
+            Fiber::ptr cur = Fiber::GetThis();
+            Fiber* fiber = cur.get();
+            cur.reset();
+            fiber->swapOut();
+            continue;
+        }
+
         int rt = 0;
-        do {
+        bool spun = false;
+        if(m_spinUs && !m_ring) {
+            {
+                MutexType::Lock lock(m_idleMutex);
+                m_leaderSpinning = true;
+            }
+            spun = spin(m_epfd, buf, next_timeout);
+            bool tickled = false;
+            {
+                MutexType::Lock lock(m_idleMutex);
+                tickled = !m_leaderSpinning;
+                m_leaderSpinning = false;
+            }
+            // 忙等期间被跳过的tickle(比如stop)不能丢，不再阻塞，回到循环开头重新检查
+            spun = spun || tickled || hasReadyTasks();
+            rt = buf.end - buf.begin;
+        }
+        while(!spun) {
             static const int MAX_TIMEOUT = 3000;
             if(next_timeout != ~0ull) {
                 next_timeout = (int)next_timeout > MAX_TIMEOUT 
@@ -304,7 +790,14 @@ void IOManager::idle() {
             } else {
                 next_timeout = MAX_TIMEOUT;
             }
-            rt = epoll_wait(m_epfd, events, MAX_EVENTS, (int)next_timeout);
+            if(m_ring) {
+                // epoll fd挂在ring上，一次系统调用既提交攒下的请求又等待完成
+                armEpoll();
+                t_uring_defer = 0;
+                m_ring->submit(1, (int)next_timeout);
+                break;
+            }
+            rt = waitEvents(m_epfd, buf, (int)next_timeout);
             if(rt < 0 && errno == EINTR) {
                 continue;
             } else {
@@ -312,71 +805,307 @@ void IOManager::idle() {
                 //                         << rt << ") (errno=" << errno << ") (errstr:" << strerror(errno) << ")";
                 break;
             }
-        } while(true);
-
-        std::vector<std::function<void()>> cbs;
-        listExpiredCb(cbs);
+        }
 
-        if(!cbs.empty()) {
-            this->schedule(cbs.begin(), cbs.end());
-            cbs.clear();
-        } 
+        // 本轮就绪的定时器和IO事件一起提交，只加一次锁、按空闲线程数唤醒
+        uint64_t begin = loopClock();
+        ScheduleBatch batch(this);
+        if(m_ring && reapIo(batch)) {
+            // CQ只能由leader收割，交出leader之前处理完
+            rt = waitEvents(m_epfd, buf, 0);
+        }
+        if(rt < 0) {
+            rt = 0;
+        }
 
-        for(int i = 0; i < rt; ++i) {
-            epoll_event& event = events[i];
-            if(event.data.fd == m_tickleFd[0]) {
-                uint8_t dummy;
-                while(::read(m_tickleFd[0], &dummy, 1) == 1); // ET仅通知一次,读干净
-                continue;
+        {
+            MutexType::Lock lock(m_idleMutex);
+            m_hasLeader = false;
+            m_leaderThread = -1;
+            if(m_leaderTickled) {
+                // 在锁内读干净，之后写入的唤醒一定会被下一个leader看到
+                char dummy[256];
+                while(::read(m_tickleFd[0], dummy, sizeof(dummy)) > 0);
+                m_leaderTickled = false;
             }
-            FdContext* fd_ctx = (FdContext*)events[i].data.ptr;
-            MutexType::Lock lock(fd_ctx->mutex);
+        }
 
-            if(event.events & (EPOLLERR | EPOLLHUP)) { // why?
-                event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
+        listExpiredTimers(batch);
+
+        processEvents(buf, m_tickleFd[0], -1, batch);
+        bool has_work = rt > 0 || spun || !batch.empty();
+        batch.commit();
+        m_loopTime.add(orange::GetCurrentUS() - begin);
+        if(has_work) {
+            // 去执行任务前交出leader，让一个follower接着等IO
+            MutexType::Lock lock(m_idleMutex);
+            if(!m_hasLeader) {
+                wakeFollower();
             }
+        }
+
+        Fiber::ptr cur = Fiber::GetThis();
+        Fiber* fiber = cur.get();
+        cur.reset();
+        fiber->swapOut();
+    } // end while
+    close(sleeper.fd);
+}
+
+namespace {
+
+// 到期定时器的回调直接移入本轮的任务批次
+class BatchSink : public TimerManager::ExpiredSink {
+public:
+    BatchSink(Scheduler::ScheduleBatch& batch)
+        :m_batch(batch) {
+    }
+
+    void add(std::function<void()>& cb) override {
+        m_batch.add(&cb);
+    }
+
+private:
+    Scheduler::ScheduleBatch& m_batch;
+};
+
+}
 
+void IOManager::listExpiredTimers(ScheduleBatch& batch) {
+    BatchSink sink(batch);
+    listExpired(sink);
+}
+
+uint64_t IOManager::loopClock() {
+    return m_cachedClock ? UpdateCachedClock() : orange::GetCurrentUS();
+}
+
+void IOManager::initEventBuffer(EventBuffer& buf) {
+    buf.batch = m_eventsMin;
+    buf.events.resize(m_eventsMin);
+}
+
+int IOManager::waitEvents(int epfd, EventBuffer& buf, int timeout) {
+    ORANGE_ASSERT(!buf.hasPending());
+    ++m_epollWaitCount;
+    int rt = epoll_wait(epfd, &buf.events[0], buf.batch, timeout);
+    buf.begin = 0;
+    buf.end = rt > 0 ? rt : 0;
+    if(rt < 0) {
+        return rt;
+    }
+    // 忙等时大量的空轮询不计入统计
+    if(rt == 0 && timeout == 0) {
+        return rt;
+    }
+    m_eventsPerWait.add(rt);
+
+    // 取满说明还有没取完的，加大下一次的数量；长时间用不到1/4再缩回去
+    if((size_t)rt == buf.batch && buf.batch < m_eventsMax) {
+        buf.batch = std::min(buf.batch * 2, m_eventsMax);
+        buf.lowRounds = 0;
+    } else if((size_t)rt < buf.batch / 4 && buf.batch > m_eventsMin) {
+        if(++buf.lowRounds >= s_shrink_rounds) {
+            buf.batch = std::max(buf.batch / 2, m_eventsMin);
+            buf.lowRounds = 0;
+        }
+    } else {
+        buf.lowRounds = 0;
+    }
+    // 只扩不缩，缩小batch后多出的内存留着下次扩大时用
+    if(buf.events.size() < buf.batch) {
+        buf.events.resize(buf.batch);
+    }
+    return rt;
+}
+
+bool IOManager::spin(int epfd, EventBuffer& buf, uint64_t next_timeout) {
+    uint64_t now = orange::GetCurrentUS();
+    uint64_t deadline = now + m_spinUs;
+    // 不越过最近的定时器
+    if(next_timeout != ~0ull) {
+        deadline = std::min(deadline, now + next_timeout * 1000);
+    }
+    while(now < deadline) {
+        if(waitEvents(epfd, buf, 0) > 0 || hasReadyTasks()) {
+            return true;
+        }
+        now = orange::GetCurrentUS();
+    }
+    return false;
+}
+
+void IOManager::processEvents(EventBuffer& buf, int wake_fd, int thread, ScheduleBatch& batch) {
+    uint64_t begin = m_eventBudgetUs ? orange::GetCurrentUS() : 0;
+    for(size_t n = 0; buf.begin < buf.end; ++n) {
+        if(m_eventBudgetUs && n && n % s_budget_check == 0
+                && orange::GetCurrentUS() - begin >= m_eventBudgetUs) {
+            break;
+        }
+        epoll_event& event = buf.events[buf.begin++];
+        if(event.data.fd == wake_fd) {
+            // 由调用方在清除唤醒标记时读干净，避免读走之后新写入的唤醒
+            continue;
+        }
+        FdContext* fd_ctx = (FdContext*)event.data.ptr;
+        MutexType::Lock lock(fd_ctx->mutex);
+
+        if(m_registerOnce) {
+            // 出错或者挂断时两个方向都要唤醒，由IO调用拿到具体错误
             int real_event = NONE;
-            if(event.events & EPOLLIN) {
+            if(event.events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
                 real_event |= READ;
             }
-            if(event.events & EPOLLOUT) {
+            if(event.events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
                 real_event |= WRITE;
             }
+            // 有等待者直接唤醒，没有的缓存到ready里
+            int waiting = real_event & fd_ctx->events;
+            fd_ctx->ready |= real_event & ~waiting;
+            if(waiting & READ) {
+                fd_ctx->triggerEvent(READ, &batch, thread);
+                --m_pendingEventCount;
+            }
+            if(waiting & WRITE) {
+                fd_ctx->triggerEvent(WRITE, &batch, thread);
+                --m_pendingEventCount;
+            }
+            continue;
+        }
 
-            if((event.events & real_event) == NONE) {
-                continue;
+        if(event.events & (EPOLLERR | EPOLLHUP)) { // why?
+            event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
+        }
+
+        int real_event = NONE;
+        if(event.events & EPOLLIN) {
+            real_event |= READ;
+        }
+        if(event.events & EPOLLOUT) {
+            real_event |= WRITE;
+        }
+        // 留到下一轮的事件可能已经被取消或者触发过了
+        real_event &= fd_ctx->events;
+
+        if(real_event == NONE) {
+            continue;
+        }
+
+        int left_event = fd_ctx->events & ~real_event;
+        int op = left_event ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        if(epollCtl(fd_ctx, op, EPOLLET | left_event)) {
+            continue;
+        }
+
+        if(real_event & READ) {
+            fd_ctx->triggerEvent(READ, &batch, thread);
+            --m_pendingEventCount;
+        }
+        if(real_event & WRITE) {
+            fd_ctx->triggerEvent(WRITE, &batch, thread);
+            --m_pendingEventCount;
+        }
+    }
+}
+
+void IOManager::reactorIdle() {
+    EventBuffer buf;
+    initEventBuffer(buf);
+
+    Reactor* reactor = nullptr;
+    {
+        MutexType::Lock lock(m_idleMutex);
+        int idx = getReactor(orange::GetThreadId());
+        for(size_t i = 0; idx < 0 && i < m_reactors.size(); ++i) {
+            if(m_reactors[i]->thread == -1) {
+                m_reactors[i]->thread = orange::GetThreadId();
+                idx = i;
             }
+        }
+        ORANGE_ASSERT(idx >= 0);
+        reactor = m_reactors[idx];
+    }
 
-            int left_event = fd_ctx->events & ~real_event;
-            int op = left_event ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-            event.events = EPOLLET | left_event;
-            int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
-            if(rt2) {
-                ORANGE_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
-                            << op << ", " << event.events << "):"
-                            << rt << " (" << errno << ") (" << strerror(errno) << ")";
-                continue;
+    while(true) {
+        uint64_t next_timeout = 0;
+        if(stopping(next_timeout)) {
+            ORANGE_LOG_INFO(g_logger) << "name: " << getName()
+                << ", reactor idle stopping exit.";
+            DisableCachedClock();
+            // 其他reactor可能还阻塞在自己的epoll上，叫醒它们检查退出条件
+            for(auto r : m_reactors) {
+                if(r != reactor) {
+                    wakeReactor(r);
+                }
             }
+            break;
+        }
 
-            if(real_event & READ) {
-                fd_ctx->triggerEvent(READ);
-                --m_pendingEventCount;
+        // 上一轮没处理完的事件先处理，不再等待
+        bool spun = false;
+        if(!buf.hasPending() && m_spinUs) {
+            reactor->spinning = true;
+            spun = spin(reactor->epfd, buf, next_timeout);
+            // 标记已被tickle清掉，说明有唤醒被跳过，不再阻塞
+            spun = !reactor->spinning.exchange(false) || spun;
+        }
+        if(!buf.hasPending() && !spun) {
+            // 先标记idle再检查inbox，和tickleThread中先放任务再看idle配对，不会丢唤醒
+            reactor->idle = true;
+            static const int MAX_TIMEOUT = 3000;
+            int timeout = next_timeout > (uint64_t)MAX_TIMEOUT ? MAX_TIMEOUT : (int)next_timeout;
+            // 忙等期间tickle可能被跳过，所以要看所有可取的任务
+            if(m_spinUs ? hasReadyTasks() : hasPinnedTasks()) {
+                timeout = 0;
             }
-            if(real_event & WRITE) {
-                fd_ctx->triggerEvent(WRITE);
-                --m_pendingEventCount;
+            // 标记idle之前其他线程改了本线程的定时器不会唤醒，重新取一次
+            uint64_t thread_timeout = getNextThreadTimer();
+            if(thread_timeout < (uint64_t)timeout) {
+                timeout = thread_timeout;
             }
+            waitEvents(reactor->epfd, buf, timeout);
+            reactor->idle = false;
         }
+
+        uint64_t begin = loopClock();
+        ScheduleBatch batch(this);
+        listExpiredTimers(batch);
+
+        // 本reactor上的fd唤醒的协程留在本线程执行
+        processEvents(buf, reactor->wakeFd, reactor->thread, batch);
+        // 读空wakeFd之后才允许再次写入
+        if(reactor->tickled) {
+            uint64_t dummy;
+            while(::read(reactor->wakeFd, &dummy, sizeof(dummy)) > 0);
+            reactor->tickled = false;
+        }
+        batch.commit();
+        m_loopTime.add(orange::GetCurrentUS() - begin);
+
         Fiber::ptr cur = Fiber::GetThis();
         Fiber* fiber = cur.get();
         cur.reset();
         fiber->swapOut();
-    } // end while
+    }
+}
+
+bool IOManager::canOwnTimers() {
+    // caller线程只在stop时才进入idle，不能持有定时器
+    return Scheduler::GetThis() == this && orange::GetThreadId() != m_rootThread;
+}
+
+void IOManager::onThreadTimerChanged(int thread) {
+    tickleThread(thread);
 }
 
 void IOManager::onTimerInsertAtFront() {
-    tickle();
+    if(m_multiReactor) {
+        tickle();
+        return;
+    }
+    // 只有leader关心定时器的超时时间
+    MutexType::Lock lock(m_idleMutex);
+    wakeLeader();
 }
 
 }  // namespace orange
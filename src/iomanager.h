@@ -1,13 +1,20 @@
 #pragma once
 
+#include <sys/epoll.h>
+
 #include <atomic>
 #include <vector>
 
+#include "histogram.h"
 #include "scheduler.h"
 #include "timer.h"
 
+struct io_uring_sqe;
+
 namespace orange {
 
+class IoUring;
+
 class IOManager : public Scheduler, public TimerManager {
 public:
     typedef std::shared_ptr<IOManager> ptr;
@@ -30,45 +37,198 @@ private:
 
         EventContext& getContext(Event event);
         void resetContext(EventContext& ctx);
-        void triggerEvent(Event event);
+        // batch不为空且属于同一个调度器时放入batch，由调用方统一提交
+        // thread不为-1时唤醒的协程只在该线程执行
+        void triggerEvent(Event event, ScheduleBatch* batch = nullptr, int thread = -1);
 
         EventContext read;
         EventContext write;
         int fd = 0;
         Event events = NONE;
+        // 注册一次模式: 已经加入epoll，边沿到达时没有等待者而缓存下来的就绪事件
+        bool registered = false;
+        int ready = NONE;
+        // io_uring上还没完成的请求数，关闭时据此决定要不要按fd取消
+        std::atomic<int> ioCount = {0};
+        // 多reactor模式下所属的reactor，-1表示还没有绑定
+        int reactor = -1;
         MutexType mutex;
     };
 
+public:
+    // io_uring后端的一次请求，完成前必须保持有效
+    struct IoRequest {
+        Scheduler* scheduler = nullptr;
+        Fiber::ptr fiber;
+        int fd = -1;
+        // 完成结果，失败为-errno
+        int res = 0;
+        // 超时等原因主动取消时由调用方设置
+        int cancelled = 0;
+    };
+
 public:
     IOManager(size_t threads = 1, bool use_caller  = true, const std::string& name = "");
     ~IOManager();
 
-    // 0 success, 1 retry, -1 error
+    /*
+    * 0 success, 1 retry, -1 error
+    * 注册一次模式下事件已经就绪时: 有cb直接调度cb返回0，等待当前协程返回1，
+    * 调用方应重试IO而不是挂起
+    */
     int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
     bool delEvent(int fd, Event event);
     bool cancelEvent(int fd, Event event);
     bool cancelAllEvent(int fd);
 
+    // 是否使用io_uring后端，epoll仍然负责addEvent注册的事件
+    bool isUring() const { return m_ring != nullptr; }
+    /*
+    * 把请求放入SQ，完成时恢复当前协程，调用方随后YielToHold
+    * 提交不一定立即进入内核，会攒到线程空闲或者达到批量大小时一起提交
+    */
+    bool submitIo(IoRequest* req, const io_uring_sqe& sqe);
+    // 请求随后以-ECANCELED完成(已经完成的不受影响)
+    void cancelIo(IoRequest* req);
+
     static IOManager* GetThis();
 
+    // tickle实际唤醒线程的次数
+    uint64_t getWakeupCount() const { return m_wakeupCount; }
+    uint64_t getEpollCtlCount() const { return m_epollCtlCount; }
+    uint64_t getEpollWaitCount() const { return m_epollWaitCount; }
+    bool isRegisterOnce() const { return m_registerOnce; }
+    // 每次epoll_wait返回的事件数
+    const Histogram& getEventsPerWait() const { return m_eventsPerWait; }
+    // 每轮处理定时器和事件花费的时间(us)，不含等待
+    const Histogram& getLoopTime() const { return m_loopTime; }
+
 protected:
     void tickle() override;
+    void tickleThread(int thread) override;
     bool stopping() override;
     void idle() override;
 
     bool stopping(uint64_t& timerout);
     void onTimerInsertAtFront() override;
+    bool canOwnTimers() override;
+    void onThreadTimerChanged(int thread) override;
+    void onTaskDone() override;
 
 private:
-    void contextResize(size_t size);
+    // fd表按页分配，页发布后不再移动，查找不加锁
+    static const int FD_PAGE_BITS = 10;
+    static const int FD_PAGE_SIZE = 1 << FD_PAGE_BITS;
+    static const int FD_MAX_PAGES = 4096;
+
+    // 每个空闲线程一个，follower阻塞在自己的eventfd上
+    struct Sleeper {
+        int fd = -1;
+        int thread = -1;
+        bool parked = false;
+    };
+
+    // 多reactor模式下每个工作线程一个，fd绑定到一个reactor后只由它的线程处理
+    struct Reactor {
+        int epfd = -1;
+        int wakeFd = -1;
+        std::atomic<int> thread = {-1};
+        // 线程在idle中，唤醒需要写wakeFd
+        std::atomic<bool> idle = {false};
+        // 已经写过wakeFd还没被处理，避免重复写
+        std::atomic<bool> tickled = {false};
+        // 线程在忙等，会自己发现新任务，tickle不用写wakeFd
+        std::atomic<bool> spinning = {false};
+    };
+
+    // 每个空闲线程一份，跨轮复用；超出时间预算没处理完的事件留到下一轮
+    struct EventBuffer {
+        std::vector<epoll_event> events;
+        // 本次epoll_wait最多取多少个，按返回数量自适应
+        size_t batch = 0;
+        size_t begin = 0;
+        size_t end = 0;
+        // 连续多少次返回数量不到batch的1/4
+        uint32_t lowRounds = 0;
+
+        bool hasPending() const { return begin < end; }
+    };
+
+    // fd超出范围，或者页不存在且auto_create为false时返回nullptr
+    FdContext* getFdContext(int fd, bool auto_create);
+    // 需要持有fd_ctx->mutex，多reactor模式下未绑定的fd先绑定再操作
+    int epollCtl(FdContext* fd_ctx, int op, uint32_t events);
+    void initEventBuffer(EventBuffer& buf);
+    // 等待事件放入buf，返回取到的数量
+    int waitEvents(int epfd, EventBuffer& buf, int timeout);
+    /*
+    * 处理buf中剩余的事件，超过时间预算时停下，剩下的下一轮处理
+    * wake_fd为唤醒用的fd，只读空不处理
+    */
+    void processEvents(EventBuffer& buf, int wake_fd, int thread, ScheduleBatch& batch);
+    // 到期定时器的回调加入batch，不经过临时数组
+    void listExpiredTimers(ScheduleBatch& batch);
+    // 每轮循环开始处理事件时取一次时间(us)，开启缓存时钟时同时刷新本线程的缓存
+    uint64_t loopClock();
+    // 阻塞等待前忙等，取到事件或者有任务可取时返回true
+    bool spin(int epfd, EventBuffer& buf, uint64_t next_timeout);
+    void reactorIdle();
+    // thread对应的reactor下标，不存在返回-1
+    int getReactor(int thread);
+    void wakeReactor(Reactor* reactor);
+    void park(Sleeper* sleeper, uint64_t timeout);
+    // 需要持有m_idleMutex
+    bool wakeFollower(Sleeper* sleeper = nullptr);
+    void wakeLeader();
+    // 提交SQ中攒下的请求
+    void flushIo();
+    // 只能由leader调用，返回epoll fd是否可读
+    bool reapIo(ScheduleBatch& batch);
+    // 只能由leader调用，把epoll fd挂到ring上
+    void armEpoll();
 
 private:
     int m_epfd = 0;
     int m_tickleFd[2]; // 0 read, 1 write
 
     std::atomic<size_t> m_pendingEventCount = {0};
-    RWMutexType m_mutex;
-    std::vector<FdContext*> m_fdContexts;
+    // 每个fd只注册一次EPOLLIN|EPOLLOUT|EPOLLET，构造时从配置读取
+    bool m_registerOnce = false;
+    std::atomic<uint64_t> m_epollCtlCount = {0};
+    std::atomic<uint64_t> m_epollWaitCount = {0};
+
+    size_t m_eventsMin = 0;
+    size_t m_eventsMax = 0;
+    uint64_t m_eventBudgetUs = 0;
+    Histogram m_eventsPerWait;
+    Histogram m_loopTime;
+    // 空闲线程阻塞前忙等的时间(us)，0不忙等
+    uint64_t m_spinUs = 0;
+    // 定时器和日志使用每轮循环刷新一次的缓存时钟
+    bool m_cachedClock = false;
+
+    // 多reactor模式，构造时从配置读取，和io_uring后端互斥
+    bool m_multiReactor = false;
+    std::vector<Reactor*> m_reactors;
+    std::atomic<uint32_t> m_nextReactor = {0};
+
+    std::shared_ptr<IoUring> m_ring;
+    MutexType m_ringMutex;
+    uint32_t m_uringBatch = 0;
+    bool m_epollArmed = false;
+    // 两级fd表，每一项指向FD_PAGE_SIZE个FdContext
+    std::atomic<FdContext*> m_fdPages[FD_MAX_PAGES];
+
+    // 同一时刻只有一个空闲线程(leader)在epoll上等待，其余空闲线程各自阻塞，
+    // tickle时只唤醒一个
+    MutexType m_idleMutex;
+    std::vector<Sleeper*> m_parked;
+    bool m_hasLeader = false;
+    int m_leaderThread = -1;
+    bool m_leaderTickled = false;
+    // leader在忙等，第一个tickle由它自己处理
+    bool m_leaderSpinning = false;
+    std::atomic<uint64_t> m_wakeupCount = {0};
 };
 
 } // namespace orange
@@ -6,6 +6,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 
+#include "blocking_pool.h"
 #include "config.h"
 
 namespace orange {
@@ -355,16 +356,72 @@ FileLogAppender::FileLogAppender(const std::string& filename)
 }
 
 void FileLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) {
-    uint64_t now = time(0);
-    if(m_lastTime != now) {
-        reopen();
-        m_lastTime = now;
+    // 磁盘卡顿时不阻塞打日志的协程。不是shared_ptr管理的对象没法异步，直接写
+    if(BlockingPool::IsEnabled() && !weak_from_this().expired()) {
+        if(m_level <= level) {
+            writeAsync(m_formatter->format(logger, level, event));
+        }
+        return;
+    }
+    Mutex::Lock file_lock(m_fileMutex);
+    // 线程池刚关闭(或者blocking_pool.threads改成0)时可能还有没写完的日志，先写掉
+    std::string pending;
+    {
+        MutexType::Lock lock(m_mutex);
+        pending.swap(m_pending);
+    }
+    checkReopen();
+    if(!pending.empty()) {
+        m_filestream << pending;
     }
     if(m_level <= level) {
         m_filestream << m_formatter->format(logger, level, event);
     }
 }
 
+void FileLogAppender::writeAsync(const std::string& msg) {
+    {
+        MutexType::Lock lock(m_mutex);
+        m_pending.append(msg);
+        if(m_flushing) {
+            return;
+        }
+        m_flushing = true;
+    }
+    FileLogAppender::ptr self = shared_from_this();
+    BlockingPoolMgr::GetInstance()->post([self]() {
+        self->flushPending();
+    });
+}
+
+void FileLogAppender::flushPending() {
+    std::string buf;
+    while(true) {
+        // 先拿文件锁再取日志，和同步写的顺序一致
+        Mutex::Lock file_lock(m_fileMutex);
+        {
+            MutexType::Lock lock(m_mutex);
+            if(m_pending.empty()) {
+                m_flushing = false;
+                return;
+            }
+            buf.swap(m_pending);
+        }
+        checkReopen();
+        m_filestream << buf;
+        m_filestream.flush();
+        buf.clear();
+    }
+}
+
+void FileLogAppender::checkReopen() {
+    uint64_t now = orange::GetCachedSeconds();
+    if(m_lastTime != now) {
+        reopen();
+        m_lastTime = now;
+    }
+}
+
 bool FileLogAppender::reopen() {
     MutexType::Lock lock(m_mutex);
     if(m_filestream) {
@@ -18,7 +18,7 @@
     if(logger->getLevel() <= level) \
         orange::LogEventWrap(std::shared_ptr<orange::LogEvent>(new orange::LogEvent(logger, level, \
                  __FILE__, __LINE__, 0, orange::GetThreadId(), \
-                orange::GetFiberId(), time(0), orange::Thread::GetName()))).getSS()
+                orange::GetFiberId(), orange::GetCachedSeconds(), orange::Thread::GetName()))).getSS()
 
 #define ORANGE_LOG_DEBUG(logger) ORANGE_LOG_LEVEL(logger, orange::LogLevel::DEBUG)
 #define ORANGE_LOG_INFO(logger) ORANGE_LOG_LEVEL(logger, orange::LogLevel::INFO)
@@ -30,7 +30,7 @@
     if(logger->getLevel() <= level) \
         orange::LogEventWrap(std::shared_ptr<orange::LogEvent>(new orange::LogEvent(logger, level, \
                 __FILE__, __LINE__, 0, orange::GetThreadId(), \
-                orange::GetFiberId(), time(0), orange::Thread::GetName()))).getEvent()->format(fmt, __VA_ARGS__)
+                orange::GetFiberId(), orange::GetCachedSeconds(), orange::Thread::GetName()))).getEvent()->format(fmt, __VA_ARGS__)
 
 #define ORANGE_LOG_FMT_DEBUG(logger, fmt, ...) ORANGE_LOG_FMT_LEVEL(logger, orange::LogLevel::DEBUG, fmt, __VA_ARGS__)
 #define ORANGE_LOG_FMT_INFO(logger, fmt, ...) ORANGE_LOG_FMT_LEVEL(logger, orange::LogLevel::INFO, fmt, __VA_ARGS__)
@@ -202,7 +202,8 @@ public:
 };
 
 // 输出到文件的Appender
-class FileLogAppender : public LogAppender {
+class FileLogAppender : public LogAppender
+        , public std::enable_shared_from_this<FileLogAppender> {
 friend class Logger;
 public:
     FileLogAppender(const std::string& filename);
@@ -212,10 +213,22 @@ public:
 
     bool reopen();
 
+private:
+    // 开启阻塞线程池时，日志先攒起来，由池里的线程写文件
+    void writeAsync(const std::string& msg);
+    void flushPending();
+    // 持有m_fileMutex时调用，每秒重新打开一次文件
+    void checkReopen();
+
 private:
     std::string m_filename;
+    // 同步写和线程池里的写都要拿，保证文件流不被并发写、日志不乱序
+    Mutex m_fileMutex;
     std::ofstream m_filestream;
     uint64_t m_lastTime = 0;
+    // 等待写入的日志，同一时间只有一个写入任务，保证顺序
+    std::string m_pending;
+    bool m_flushing = false;
 };
 
 class LoggerManager {
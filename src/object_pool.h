@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "mutex.h"
+
+namespace orange {
+
+/*
+* 侵入式对象池，T需要有 T* next 成员
+* 每个线程一个本地空闲链表，超过上限时批量还给全局链表，
+* 本地为空时从全局批量取，稳定状态下不会有堆分配
+* 对象归还前由调用方负责清理
+*/
+template<class T>
+class ObjectPool {
+public:
+    typedef SpinLock MutexType;
+    static const size_t BATCH = 128;
+
+    static T* Alloc() {
+        Cache& cache = GetCache();
+        if(!cache.head) {
+            Global& g = GetGlobal();
+            MutexType::Lock lock(g.mutex);
+            // 一次取一批
+            for(size_t i = 0; i < BATCH && g.head; ++i) {
+                T* v = g.head;
+                g.head = v->next;
+                v->next = cache.head;
+                cache.head = v;
+                ++cache.size;
+            }
+        }
+        if(!cache.head) {
+            return new T();
+        }
+        T* v = cache.head;
+        cache.head = v->next;
+        --cache.size;
+        v->next = nullptr;
+        return v;
+    }
+
+    static void Free(T* v) {
+        Cache& cache = GetCache();
+        v->next = cache.head;
+        cache.head = v;
+        if(++cache.size >= BATCH * 2) {
+            cache.release(BATCH);
+        }
+    }
+
+private:
+    struct Global {
+        MutexType mutex;
+        T* head = nullptr;
+    };
+
+    struct Cache {
+        T* head = nullptr;
+        size_t size = 0;
+
+        void release(size_t count) {
+            T* first = head;
+            T* last = head;
+            size_t moved = 1;
+            for(; moved < count && last->next; ++moved) {
+                last = last->next;
+            }
+            head = last->next;
+            size -= moved;
+
+            Global& g = GetGlobal();
+            MutexType::Lock lock(g.mutex);
+            last->next = g.head;
+            g.head = first;
+        }
+
+        // 线程退出时全部还给全局链表
+        ~Cache() {
+            if(head) {
+                release(size);
+            }
+        }
+    };
+
+    static Global& GetGlobal() {
+        // 不析构，线程退出时可能还在使用
+        static Global* s_global = new Global;
+        return *s_global;
+    }
+
+    static Cache& GetCache() {
+        static thread_local Cache s_cache;
+        return s_cache;
+    }
+};
+
+} // namespace orange
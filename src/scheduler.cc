@@ -1,5 +1,8 @@
 #include "scheduler.h"
 
+#include <algorithm>
+
+#include "config.h"
 #include "hook.h"
 #include "log.h"
 #include "macro.h"
@@ -8,8 +11,18 @@ namespace orange {
 
 static orange::Logger::ptr g_logger = ORANGE_LOG_NAME("system");
 
+static orange::ConfigVar<uint32_t>::ptr g_scheduler_queue_size =
+    orange::Config::Lookup<uint32_t>("scheduler.queue_size", 1024, "scheduler worker local queue size");
+
+static orange::ConfigVar<uint32_t>::ptr g_scheduler_fiber_pool_high =
+    orange::Config::Lookup<uint32_t>("scheduler.fiber_pool_high", 1024, "scheduler worker fiber pool high watermark");
+
+static orange::ConfigVar<uint32_t>::ptr g_scheduler_fiber_pool_low =
+    orange::Config::Lookup<uint32_t>("scheduler.fiber_pool_low", 256, "scheduler worker fiber pool low watermark");
+
 static thread_local Scheduler* t_scheduler = nullptr;
 static thread_local Fiber* t_scheduler_fiber = nullptr;
+static thread_local void* t_worker = nullptr;
 
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name) 
     :m_name(name) {
@@ -32,6 +45,14 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name)
         m_rootThread = -1;
     }
     m_threadCount = threads;
+
+    size_t workers = m_threadCount + (m_rootThread == -1 ? 0 : 1);
+    for(size_t i = 0; i < workers; ++i) {
+        m_workers.push_back(new Worker(this, g_scheduler_queue_size->getValue()));
+    }
+    if(m_rootThread != -1) {
+        m_workers[0]->thread = m_rootThread;
+    }
 }
 
 Scheduler::~Scheduler() {
@@ -39,6 +60,20 @@ Scheduler::~Scheduler() {
     if(GetThis() == this) {
         t_scheduler = nullptr;
     }
+    while(FiberAndThread* ft = m_fibers.head) {
+        m_fibers.erase(nullptr, ft);
+        releaseTask(ft);
+    }
+    for(auto w : m_workers) {
+        while(FiberAndThread* ft = w->queue.pop()) {
+            releaseTask(ft);
+        }
+        while(FiberAndThread* ft = w->inbox.head) {
+            w->inbox.erase(nullptr, ft);
+            releaseTask(ft);
+        }
+        delete w;
+    }
 }
 
 Scheduler* Scheduler::GetThis() {
@@ -57,10 +92,12 @@ void Scheduler::start() {
     m_stopping = false;
     ORANGE_ASSERT(m_threads.empty());
     m_threads.resize(m_threadCount);
+    size_t offset = m_workers.size() - m_threadCount;
     for(size_t i = 0; i < m_threadCount; ++i) {
         m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this)
                             , m_name + std::to_string(i)));
         m_threadIds.push_back(m_threads[i]->getId());
+        m_workers[offset + i]->thread = m_threads[i]->getId();
     }
 }
 
@@ -123,6 +160,19 @@ void Scheduler::run() {
         t_scheduler_fiber = orange::Fiber::GetThis().get();
     }
 
+    {
+        // 等待start()登记完所有线程
+        MutexType::Lock lock(m_mutex);
+        for(auto w : m_workers) {
+            if(w->thread == orange::GetThreadId()) {
+                t_worker = w;
+                break;
+            }
+        }
+    }
+    Worker* self = getWorker();
+    ORANGE_ASSERT(self);
+
     Fiber::ptr cb_fiber;
     Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
 
@@ -133,30 +183,14 @@ void Scheduler::run() {
         bool tickle_me = false;
         bool is_active = false;
 
-        {
-            MutexType::Lock lock(m_mutex);
-            auto it = m_fibers.begin();
-            while(it != m_fibers.end()) {
-                if(it->thread != -1 && it->thread != orange::GetThreadId()) {
-                    tickle_me = true;
-                    ++it;
-                    continue;
-                }
-
-                ORANGE_ASSERT(it->fiber || it->cb);
-
-                if(it->fiber && it->fiber->getState() == Fiber::EXEC) {
-                    ++it;
-                    continue;
-                }
-
-                ft = *it;
-                m_fibers.erase(it++);
-                ++m_activeThreadCount;
-                is_active = true;
-                break;
-            }
-            tickle_me |= (it != m_fibers.end());
+        FiberAndThread* task = dequeue(tickle_me);
+        if(task) {
+            ft.fiber.swap(task->fiber);
+            ft.cb = std::move(task->cb);
+            releaseTask(task);
+            self->taskCount.fetch_add(1, std::memory_order_relaxed);
+            ++m_activeThreadCount;
+            is_active = true;
         }
 
         if(tickle_me) {
@@ -173,16 +207,26 @@ void Scheduler::run() {
             }else if(ft.fiber->getState() != Fiber::TERM
                         && ft.fiber->getState() != Fiber::EXCPT) {
                 ft.fiber->setState(Fiber::HOLD);
+            } else {
+                recycleFiber(self, ft.fiber);
             }
             ft.reset();
+            onTaskDone();
         } else if(ft.cb) {
+            // 协程开始执行时把回调移到自己的栈上，std::function只保存一个指针，不会堆分配
+            InlineFunction* cb = &ft.cb;
+            std::function<void()> entry = [cb]() {
+                InlineFunction func(std::move(*cb));
+                func();
+            };
             if(cb_fiber) {
-                cb_fiber->reset(ft.cb);
+                cb_fiber->reset(entry);
+                self->fiberPoolHits.fetch_add(1, std::memory_order_relaxed);
             } else {
-                cb_fiber.reset(new Fiber(ft.cb));
+                cb_fiber = allocFiber(self, entry);
             }
-            ft.reset();
             cb_fiber->swapIn();
+            ft.reset();
             --m_activeThreadCount;
 
             if(cb_fiber->getState() == Fiber::READY) {
@@ -195,6 +239,7 @@ void Scheduler::run() {
                 cb_fiber->m_state = Fiber::HOLD;
                 cb_fiber.reset();
             }
+            onTaskDone();
         } else {
             if(is_active) {
                 --m_activeThreadCount;
@@ -203,11 +248,17 @@ void Scheduler::run() {
 
             if(idle_fiber->getState() == Fiber::TERM) {
                 ORANGE_LOG_INFO(g_logger) << "idle fiber term";
+                // 在本线程释放，栈还给本线程的缓存
+                self->fiberPool.clear();
+                self->fiberPoolSize = 0;
+                t_worker = nullptr;
                 break;
             }
             // ORANGE_LOG_INFO(g_logger) << "idle fiber " << idle_fiber->getState();
             ++m_idleThreadCount;
+            self->idling = true;
             idle_fiber->swapIn();
+            self->idling = false;
             --m_idleThreadCount;
 
             if(idle_fiber->getState() != Fiber::TERM
@@ -218,18 +269,331 @@ void Scheduler::run() {
     }
 }
 
+void Scheduler::releaseTask(FiberAndThread* ft) {
+    ft->reset();
+    ObjectPool<FiberAndThread>::Free(ft);
+}
+
+Scheduler::Worker* Scheduler::getWorker() {
+    Worker* w = (Worker*)t_worker;
+    if(w && w->scheduler == this) {
+        return w;
+    }
+    return nullptr;
+}
+
+Scheduler::Worker* Scheduler::getWorker(int thread) {
+    for(auto w : m_workers) {
+        if(w->thread == thread) {
+            return w;
+        }
+    }
+    return nullptr;
+}
+
+bool Scheduler::enqueue(FiberAndThread* ft) {
+    if(ft->thread != -1) {
+        Worker* target = getWorker(ft->thread);
+        if(target) {
+            int thread = ft->thread;
+            bool need_tickle = false;
+            ft->enqueueUs = orange::GetCurrentUS();
+            {
+                MutexType::Lock lock(target->inboxMutex);
+                target->inbox.push_back(ft);
+                // 提交给自己不需要唤醒
+                need_tickle = target->inboxSize++ == 0 && target != getWorker();
+            }
+            if(need_tickle) {
+                tickleThread(thread);
+            }
+            return false;
+        }
+    }
+
+    // 是否真的需要唤醒由tickle()根据空闲线程决定
+    Worker* w = getWorker();
+    if(ft->thread == -1 && w && w->queue.push(ft)) {
+        return true;
+    }
+
+    MutexType::Lock lock(m_mutex);
+    m_fibers.push_back(ft);
+    return true;
+}
+
+void Scheduler::commit(TaskList& tasks) {
+    Worker* self = getWorker();
+    TaskList global;
+    size_t unpinned = 0;
+    while(FiberAndThread* ft = tasks.head) {
+        tasks.erase(nullptr, ft);
+        if(ft->thread != -1) {
+            Worker* target = getWorker(ft->thread);
+            if(target) {
+                int thread = ft->thread;
+                bool need_tickle = false;
+                ft->enqueueUs = orange::GetCurrentUS();
+                {
+                    MutexType::Lock lock(target->inboxMutex);
+                    target->inbox.push_back(ft);
+                    need_tickle = target->inboxSize++ == 0 && target != self;
+                }
+                if(need_tickle) {
+                    tickleThread(thread);
+                }
+                continue;
+            }
+        }
+        ++unpinned;
+        if(ft->thread == -1 && self && self->queue.push(ft)) {
+            continue;
+        }
+        global.push_back(ft);
+    }
+
+    if(!global.empty()) {
+        MutexType::Lock lock(m_mutex);
+        m_fibers.append(global);
+    }
+
+    // 在idle中提交时当前线程自己会取一个任务，不用唤醒自己
+    size_t idle = m_idleThreadCount;
+    if(self && self->idling) {
+        unpinned = unpinned ? unpinned - 1 : 0;
+        idle = idle ? idle - 1 : 0;
+    }
+    size_t wakeups = std::min(unpinned, idle);
+    for(size_t i = 0; i < wakeups; ++i) {
+        tickle();
+    }
+}
+
+Scheduler::FiberAndThread* Scheduler::popInbox(Worker* self, bool& tickle_me) {
+    if(self->inboxSize == 0) {
+        return nullptr;
+    }
+    FiberAndThread* ft = nullptr;
+    {
+        MutexType::Lock lock(self->inboxMutex);
+        FiberAndThread* prev = nullptr;
+        for(FiberAndThread* it = self->inbox.head; it; prev = it, it = it->next) {
+            // 协程还在其他线程上没切出
+            if(it->fiber && it->fiber->getState() == Fiber::EXEC) {
+                tickle_me = true;
+                continue;
+            }
+            ft = it;
+            self->inbox.erase(prev, it);
+            --self->inboxSize;
+            break;
+        }
+    }
+    if(!ft) {
+        return nullptr;
+    }
+
+    uint64_t wait = orange::GetCurrentUS() - ft->enqueueUs;
+    self->pinnedCount.fetch_add(1, std::memory_order_relaxed);
+    self->pinnedWaitUs.fetch_add(wait, std::memory_order_relaxed);
+    if(wait > self->pinnedMaxWaitUs.load(std::memory_order_relaxed)) {
+        self->pinnedMaxWaitUs.store(wait, std::memory_order_relaxed);
+    }
+    return ft;
+}
+
+Scheduler::FiberAndThread* Scheduler::popLocal(Worker* self, bool& tickle_me) {
+    // 本地队列也从top端按FIFO取，避免反复提交自己的任务饿死其他任务
+    while(!self->queue.empty()) {
+        FiberAndThread* ft = self->queue.steal();
+        if(ft) {
+            return checkExec(ft, tickle_me);
+        }
+    }
+    return nullptr;
+}
+
+Scheduler::FiberAndThread* Scheduler::popGlobal(bool& tickle_me) {
+    FiberAndThread* ft = nullptr;
+    MutexType::Lock lock(m_mutex);
+    FiberAndThread* prev = nullptr;
+    for(FiberAndThread* it = m_fibers.head; it; prev = it, it = it->next) {
+        // 只有指定了不存在的线程才会留在全局队列
+        if(it->thread != -1 && it->thread != orange::GetThreadId()) {
+            continue;
+        }
+
+        ORANGE_ASSERT(it->fiber || it->cb);
+
+        if(it->fiber && it->fiber->getState() == Fiber::EXEC) {
+            continue;
+        }
+
+        ft = it;
+        m_fibers.erase(prev, it);
+        break;
+    }
+    return ft;
+}
+
+Scheduler::FiberAndThread* Scheduler::checkExec(FiberAndThread* ft, bool& tickle_me) {
+    if(!ft->fiber || ft->fiber->getState() != Fiber::EXEC) {
+        return ft;
+    }
+    // 协程还没切出，放回全局队列
+    MutexType::Lock lock(m_mutex);
+    m_fibers.push_back(ft);
+    tickle_me = true;
+    return nullptr;
+}
+
+Scheduler::FiberAndThread* Scheduler::dequeue(bool& tickle_me) {
+    Worker* self = getWorker();
+    FiberAndThread* ft = nullptr;
+    uint32_t tick = ++self->tick;
+
+    // inbox和本地队列轮流优先，避免互相饿死；
+    // 每隔一段时间先看一次全局队列，避免外部提交的任务饿死
+    if(tick % 61 == 0 && (ft = popGlobal(tickle_me))) {
+        return ft;
+    }
+    if(tick & 1) {
+        if((ft = popInbox(self, tickle_me)) || (ft = popLocal(self, tickle_me))) {
+            return ft;
+        }
+    } else {
+        if((ft = popLocal(self, tickle_me)) || (ft = popInbox(self, tickle_me))) {
+            return ft;
+        }
+    }
+    if((ft = popGlobal(tickle_me))) {
+        return ft;
+    }
+
+    size_t count = m_workers.size();
+    size_t start = (size_t)orange::GetThreadId() % count;
+    for(size_t i = 0; i < count; ++i) {
+        Worker* victim = m_workers[(start + i) % count];
+        if(victim == self) {
+            continue;
+        }
+        ft = victim->queue.steal();
+        if(ft) {
+            return checkExec(ft, tickle_me);
+        }
+    }
+    return nullptr;
+}
+
+Scheduler::PinnedStat Scheduler::getPinnedStat(int thread) {
+    PinnedStat stat;
+    for(auto w : m_workers) {
+        if(thread != -1 && w->thread != thread) {
+            continue;
+        }
+        stat.count += w->pinnedCount.load(std::memory_order_relaxed);
+        stat.totalWaitUs += w->pinnedWaitUs.load(std::memory_order_relaxed);
+        stat.maxWaitUs = std::max(stat.maxWaitUs
+                , w->pinnedMaxWaitUs.load(std::memory_order_relaxed));
+    }
+    return stat;
+}
+
+Fiber::ptr Scheduler::allocFiber(Worker* self, std::function<void()> cb) {
+    if(!self->fiberPool.empty()) {
+        Fiber::ptr fiber = std::move(self->fiberPool.back());
+        self->fiberPool.pop_back();
+        self->fiberPoolSize = self->fiberPool.size();
+        self->fiberPoolHits.fetch_add(1, std::memory_order_relaxed);
+        fiber->reset(cb);
+        return fiber;
+    }
+    self->fiberPoolMisses.fetch_add(1, std::memory_order_relaxed);
+    Fiber::ptr fiber(new Fiber(cb, 0, false, m_sharedStack));
+    self->fiberStackSize = fiber->getStackSize();
+    return fiber;
+}
+
+void Scheduler::recycleFiber(Worker* self, Fiber::ptr& fiber) {
+    // 还有其他地方持有，或者栈和回调协程不同的不回收
+    if(fiber.use_count() != 1
+            || fiber->isSharedStack() != m_sharedStack
+            || fiber->getStackSize() != self->fiberStackSize) {
+        return;
+    }
+    // 释放回调里捕获的对象
+    fiber->reset(nullptr);
+    self->fiberPool.push_back(std::move(fiber));
+    // 超过高水位时一次缩到低水位，避免在水位附近反复创建销毁
+    size_t high = g_scheduler_fiber_pool_high->getValue();
+    if(self->fiberPool.size() > high) {
+        size_t low = std::min((size_t)g_scheduler_fiber_pool_low->getValue(), high);
+        self->fiberPool.resize(low);
+    }
+    self->fiberPoolSize = self->fiberPool.size();
+}
+
+Scheduler::FiberPoolStat Scheduler::getFiberPoolStat() {
+    FiberPoolStat stat;
+    for(auto w : m_workers) {
+        stat.hits += w->fiberPoolHits.load(std::memory_order_relaxed);
+        stat.misses += w->fiberPoolMisses.load(std::memory_order_relaxed);
+        stat.size += w->fiberPoolSize.load(std::memory_order_relaxed);
+    }
+    return stat;
+}
+
+uint64_t Scheduler::getTaskCount() {
+    uint64_t count = 0;
+    for(auto w : m_workers) {
+        count += w->taskCount.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
 bool Scheduler::hasIdleThreads() {
     return m_idleThreadCount > 0;
 }
 
+bool Scheduler::hasPinnedTasks() {
+    Worker* self = getWorker();
+    return self && self->inboxSize != 0;
+}
+
+bool Scheduler::hasReadyTasks() {
+    Worker* self = getWorker();
+    if(self && self->inboxSize != 0) {
+        return true;
+    }
+    for(auto w : m_workers) {
+        if(!w->queue.empty()) {
+            return true;
+        }
+    }
+    MutexType::Lock lock(m_mutex);
+    return !m_fibers.empty();
+}
+
 void Scheduler::tickle() {
     // ORANGE_LOG_INFO(g_logger) << "tickle";
 }
 
+void Scheduler::tickleThread(int thread) {
+    tickle();
+}
+
 bool Scheduler::stopping() {
     MutexType::Lock lock(m_mutex);
-    return m_autoStop && m_stopping
-        && m_fibers.empty() && m_activeThreadCount == 0;
+    if(!m_autoStop || !m_stopping
+            || !m_fibers.empty() || m_activeThreadCount != 0) {
+        return false;
+    }
+    for(auto w : m_workers) {
+        if(!w->queue.empty() || w->inboxSize != 0) {
+            return false;
+        }
+    }
+    return true;
 }
 
 void Scheduler::idle() {
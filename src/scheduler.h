@@ -1,13 +1,17 @@
 #pragma once
 
+#include <atomic>
 #include <functional>
-#include <list>
 #include <memory>
 #include <vector>
 
 #include "fiber.h"
+#include "inline_function.h"
 #include "mutex.h"
+#include "noncopyable.h"
+#include "object_pool.h"
 #include "thread.h"
+#include "work_steal_queue.h"
 
 namespace orange {
 
@@ -15,115 +19,291 @@ class Scheduler {
 public:
     typedef std::shared_ptr<Scheduler> ptr;
     typedef orange::Mutex MutexType;
+
+    // 指定线程的任务从提交到开始执行的等待时间
+    struct PinnedStat {
+        uint64_t count = 0;
+        uint64_t totalWaitUs = 0;
+        uint64_t maxWaitUs = 0;
+    };
+
     Scheduler(size_t threads = 1, bool use_caller  = true, const std::string& name = "");
     virtual ~Scheduler();
 
     const std::string& getName() const { return m_name; }
 
+    // 回调协程是否使用共享栈，只影响之后新建的协程
+    void setSharedStack(bool v) { m_sharedStack = v; }
+    bool isSharedStack() const { return m_sharedStack; }
+
     static Scheduler* GetThis();
     static Fiber* GetMainFiber();
 
     void start();
     void stop();
 
+    // thread = -1 时汇总所有工作线程
+    PinnedStat getPinnedStat(int thread = -1);
+    // 已执行的任务数
+    uint64_t getTaskCount();
+
+    // 回调协程复用情况，hits为复用已结束的协程，misses为新建协程
+    struct FiberPoolStat {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t size = 0;
+    };
+    FiberPoolStat getFiberPoolStat();
+
     template<class FiberOrCb>
     void schedule(FiberOrCb fc, int thread = -1) {
-        bool need_tickle = false;
-        {
-            MutexType::Lock lock(m_mutex);
-            need_tickle = scheduleNoLock(fc, thread);
-        }
-        if(need_tickle) {
+        if(scheduleNoLock(fc, thread)) {
             tickle();
         }
     }
 
     template<class InputIterator>
-    void schedule(InputIterator begin, InputIterator end) {
-        bool need_tickle = false;
-        {
-            MutexType::Lock lock(m_mutex);
-            while(begin != end) {
-                need_tickle = scheduleNoLock(&*begin, -1) | need_tickle;
-                ++begin; 
-            }
-        }
-        if(need_tickle) {
-            tickle();
-        }
-    }
+    void schedule(InputIterator begin, InputIterator end);
+
+    class ScheduleBatch;
 
 protected:
     virtual void tickle();
+    // 唤醒指定线程，用于指定线程的任务
+    virtual void tickleThread(int thread);
     virtual bool stopping();
     virtual void idle();
+    // 工作线程每执行完(或者切出)一个任务调用一次
+    virtual void onTaskDone() {}
 
     void run();
     void setThis();
     bool hasIdleThreads();
+    // 当前线程的inbox里是否有指定给它的任务
+    bool hasPinnedTasks();
+    // 当前线程是否有任务可取(inbox、各线程本地队列、全局队列)，空闲线程忙等时检查
+    bool hasReadyTasks();
 
 private:
+    struct FiberAndThread;
+    struct Worker;
+
+    struct TaskList;
+
+    // 空的协程和回调返回nullptr
     template<class FiberOrCb>
-    bool scheduleNoLock(FiberOrCb fc, int thread = -1) {
-        bool need_tickle = m_fibers.empty();
-        FiberAndThread ft(fc, thread);
-        if(ft.fiber || ft.cb) {
-            m_fibers.push_back(ft);
+    static FiberAndThread* NewTask(FiberOrCb fc, int thread) {
+        FiberAndThread* ft = ObjectPool<FiberAndThread>::Alloc();
+        ft->set(std::move(fc));
+        if(!ft->fiber && !ft->cb) {
+            ObjectPool<FiberAndThread>::Free(ft);
+            return nullptr;
         }
-        return need_tickle;
+        // 共享栈协程只能回到原来的线程
+        if(thread == -1 && ft->fiber) {
+            thread = ft->fiber->getPinnedThread();
+        }
+        ft->thread = thread;
+        return ft;
+    }
+
+    template<class FiberOrCb>
+    bool scheduleNoLock(FiberOrCb fc, int thread = -1) {
+        FiberAndThread* ft = NewTask(std::move(fc), thread);
+        return ft && enqueue(ft);
     }
 
+    void releaseTask(FiberAndThread* ft);
+    void commit(TaskList& tasks);
+    Worker* getWorker();
+    Worker* getWorker(int thread);
+    bool enqueue(FiberAndThread* ft);
+    FiberAndThread* popInbox(Worker* self, bool& tickle_me);
+    FiberAndThread* popLocal(Worker* self, bool& tickle_me);
+    FiberAndThread* popGlobal(bool& tickle_me);
+    FiberAndThread* checkExec(FiberAndThread* ft, bool& tickle_me);
+    FiberAndThread* dequeue(bool& tickle_me);
+    Fiber::ptr allocFiber(Worker* self, std::function<void()> cb);
+    void recycleFiber(Worker* self, Fiber::ptr& fiber);
+
 private:
+    // 侵入式任务节点，由ObjectPool复用，回调小于InlineFunction::INLINE_SIZE时不做堆分配
     struct FiberAndThread {
         Fiber::ptr fiber;
-        std::function<void()> cb;
-        int thread;
+        InlineFunction cb;
+        int thread = -1;
+        uint64_t enqueueUs = 0;
+        FiberAndThread* next = nullptr;
 
-        FiberAndThread(Fiber::ptr f, int thr)
-            :fiber(f)
-            ,thread(thr) {
+        void set(Fiber::ptr f) {
+            fiber.swap(f);
         }
 
-        FiberAndThread(Fiber::ptr* f, int thr)
-            :thread(thr) {
+        void set(Fiber::ptr* f) {
             fiber.swap(*f);
         }
 
-        FiberAndThread(std::function<void()> f, int thr)
-            :cb(f), thread(thr) {
-        }
-
-        FiberAndThread(std::function<void()>* f, int thr) 
-            :thread(thr) {
-            cb.swap(*f);
+        void set(std::function<void()>* f) {
+            cb = std::move(*f);
+            *f = nullptr;
         }
 
-        FiberAndThread()
-            :thread(-1) {
+        template<class F>
+        void set(F&& f) {
+            cb = InlineFunction(std::forward<F>(f));
         }
 
         void reset() {
             fiber = nullptr;
             cb = nullptr;
             thread  = -1;
+            enqueueUs = 0;
+            next = nullptr;
+        }
+    };
+
+    struct TaskList {
+        FiberAndThread* head = nullptr;
+        FiberAndThread* tail = nullptr;
+
+        bool empty() const { return head == nullptr; }
+
+        void push_back(FiberAndThread* ft) {
+            ft->next = nullptr;
+            if(tail) {
+                tail->next = ft;
+            } else {
+                head = ft;
+            }
+            tail = ft;
+        }
+
+        // prev为nullptr时删除头节点
+        void erase(FiberAndThread* prev, FiberAndThread* ft) {
+            if(prev) {
+                prev->next = ft->next;
+            } else {
+                head = ft->next;
+            }
+            if(tail == ft) {
+                tail = prev;
+            }
+            ft->next = nullptr;
+        }
+
+        void append(TaskList& oth) {
+            if(oth.empty()) {
+                return;
+            }
+            if(tail) {
+                tail->next = oth.head;
+            } else {
+                head = oth.head;
+            }
+            tail = oth.tail;
+            oth.head = oth.tail = nullptr;
+        }
+    };
+
+    // 每个工作线程一个本地队列，空闲时从其他线程窃取
+    // 指定线程的任务放入该线程的inbox，只有该线程会取
+    struct Worker {
+        Scheduler* scheduler = nullptr;
+        int thread = -1;
+        WorkStealQueue<FiberAndThread> queue;
+        uint32_t tick = 0;
+        bool idling = false;
+
+        MutexType inboxMutex;
+        TaskList inbox;
+        std::atomic<size_t> inboxSize = {0};
+
+        std::atomic<uint64_t> taskCount = {0};
+
+        // 已结束的回调协程，保留栈复用
+        std::vector<Fiber::ptr> fiberPool;
+        uint32_t fiberStackSize = 0;
+        std::atomic<uint64_t> fiberPoolSize = {0};
+        std::atomic<uint64_t> fiberPoolHits = {0};
+        std::atomic<uint64_t> fiberPoolMisses = {0};
+
+        std::atomic<uint64_t> pinnedCount = {0};
+        std::atomic<uint64_t> pinnedWaitUs = {0};
+        std::atomic<uint64_t> pinnedMaxWaitUs = {0};
+
+        Worker(Scheduler* s, size_t capacity)
+            :scheduler(s)
+            ,queue(capacity) {
         }
     };
 
 private:
     MutexType m_mutex;
     std::vector<Thread::ptr> m_threads;
-    std::list<FiberAndThread> m_fibers;
+    // 非工作线程提交、本地队列溢出的任务
+    TaskList m_fibers;
+    std::vector<Worker*> m_workers;
     Fiber::ptr m_rootFiber;
     std::string m_name;
+    bool m_sharedStack = false;
 
 protected:
     std::vector<int> m_threadIds;
     size_t m_threadCount = 0;
-    size_t m_activeThreadCount = 0;
-    size_t m_idleThreadCount = 0;
+    std::atomic<size_t> m_activeThreadCount = {0};
+    std::atomic<size_t> m_idleThreadCount = {0};
     bool m_stopping = true;;
     bool m_autoStop = false;
     int m_rootThread = 0;
 };
 
+/*
+* 批量提交任务：先在本地收集，commit时全局队列只加一次锁，
+* 唤醒次数不超过空闲线程数。析构时自动commit
+*/
+class Scheduler::ScheduleBatch : Noncopyable {
+public:
+    ScheduleBatch(Scheduler* scheduler)
+        :m_scheduler(scheduler) {
+    }
+
+    ~ScheduleBatch() {
+        commit();
+    }
+
+    Scheduler* getScheduler() const { return m_scheduler; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    template<class FiberOrCb>
+    void add(FiberOrCb fc, int thread = -1) {
+        FiberAndThread* ft = NewTask(std::move(fc), thread);
+        if(ft) {
+            m_tasks.push_back(ft);
+            ++m_size;
+        }
+    }
+
+    void commit() {
+        if(m_size) {
+            m_scheduler->commit(m_tasks);
+            m_size = 0;
+        }
+    }
+
+private:
+    Scheduler* m_scheduler;
+    TaskList m_tasks;
+    size_t m_size = 0;
+};
+
+template<class InputIterator>
+void Scheduler::schedule(InputIterator begin, InputIterator end) {
+    ScheduleBatch batch(this);
+    while(begin != end) {
+        batch.add(&*begin);
+        ++begin;
+    }
+}
+
 }
@@ -4,6 +4,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 
+#include "config.h"
 #include "fd_manager.h"
 #include "hook.h"
 #include "iomanager.h"
@@ -14,6 +15,10 @@ namespace orange {
 
 static orange::Logger::ptr g_logger = ORANGE_LOG_NAME("system");
 
+static orange::ConfigVar<uint32_t>::ptr g_socket_busy_poll_us =
+    orange::Config::Lookup<uint32_t>("socket.busy_poll_us", 0
+            , "SO_BUSY_POLL(us) for ipv4/ipv6 sockets, 0 for off");
+
 Socket::ptr Socket::CreateTCP(Address::ptr addr) {
     Socket::ptr sock(new Socket(addr->getFamily(), TCP, 0));
     return sock;
@@ -76,7 +81,7 @@ int64_t Socket::getSendTimeout() const {
 
 void Socket::setSendTimeout(int64_t timeout_ms) {
     struct timeval tv{(int)(timeout_ms / 1000), (int)(timeout_ms % 1000 * 1000)};
-    setOption(SOL_SOCKET, SO_RCVTIMEO, &tv);
+    setOption(SOL_SOCKET, SO_SNDTIMEO, tv);
 }
 
 int64_t Socket::getRecvTimeout() const {
@@ -88,8 +93,8 @@ int64_t Socket::getRecvTimeout() const {
 }
 
 void Socket::setRecvTimeout(int64_t timeout_ms) {
-    struct timeval tv{(int)(timeout_ms / 1000), (int)(timeout_ms % 1000 / 1000)};
-    setOption(SOL_SOCKET, SO_RCVTIMEO, &tv);
+    struct timeval tv{(int)(timeout_ms / 1000), (int)(timeout_ms % 1000 * 1000)};
+    setOption(SOL_SOCKET, SO_RCVTIMEO, tv);
 }
 
 bool Socket::getOption(int level, int option, void* result, size_t* len) {
@@ -258,6 +263,24 @@ int Socket::sendTo(const iovec* buffer, size_t length, const Address::ptr to, in
     return -1;
 }
 
+int64_t Socket::sendFile(int fd, off_t offset, size_t length) {
+    if(!isConnected()) {
+        return -1;
+    }
+    size_t left = length;
+    while(left > 0) {
+        ssize_t rt = ::sendfile(m_sock, fd, &offset, left);
+        if(rt < 0) {
+            // 已经发出去一部分时返回已发送的字节数，调用方可以从offset + 返回值继续
+            return left < length ? (int64_t)(length - left) : -1;
+        } else if(rt == 0) {
+            break;
+        }
+        left -= rt;
+    }
+    return length - left;
+}
+
 int Socket::recv(void* buffer, size_t length, int flags) {
     if(isConnected()) {
         return ::recv(m_sock, buffer, length, flags);
@@ -423,6 +446,11 @@ void Socket::initSock() {
     if(m_type == SOCK_STREAM) {
         setOption(IPPROTO_TCP, TCP_NODELAY, val);
     }
+    // 接收时在驱动队列上忙等，超过net.core.busy_read需要CAP_NET_ADMIN，失败忽略
+    int busy_poll = g_socket_busy_poll_us->getValue();
+    if(busy_poll > 0 && (m_family == AF_INET || m_family == AF_INET6)) {
+        setOption(SOL_SOCKET, SO_BUSY_POLL, busy_poll);
+    }
 }
 
 void Socket::newSocket() {
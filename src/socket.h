@@ -64,6 +64,11 @@ public:
     int send(const iovec* buffer, size_t length, int flags = 0);
     int sendTo(const void* buffer, size_t length, const Address::ptr to, int flags = 0);
     int sendTo(const iovec* buffer, size_t length, const Address::ptr to, int flags = 0);
+    /*
+    * 用sendfile发送文件fd从offset开始的length字节，返回发送的字节数
+    * 文件不够长或者发送了一部分之后出错时小于length(出错原因在errno里)，一个字节都没发出去时返回-1
+    */
+    int64_t sendFile(int fd, off_t offset, size_t length);
 
     int recv(void* buffer, size_t length, int flags = 0);
     int recv(iovec* buffer, size_t length, int flags = 0);
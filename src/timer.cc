@@ -1,9 +1,29 @@
 #include "timer.h"
 
+#include <string.h>
+
+#include <algorithm>
+
+#include "config.h"
+#include "macro.h"
+#include "object_pool.h"
 #include "util.h"
 
 namespace orange {
 
+static orange::ConfigVar<bool>::ptr g_timer_wheel =
+    orange::Config::Lookup<bool>("timer.wheel", false
+            , "use a hierarchical timing wheel instead of std::set for timers");
+
+static orange::ConfigVar<bool>::ptr g_timer_per_thread =
+    orange::Config::Lookup<bool>("timer.per_thread", false
+            , "timers added on an IOManager worker live in that worker's own heap");
+
+static std::atomic<uint64_t> s_timer_manager_id = {0};
+// 当前线程的定时器堆和它所属管理器的id
+static thread_local uint64_t t_timers_owner = 0;
+static thread_local ThreadTimers* t_thread_timers = nullptr;
+
 bool Timer::Comparator::operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const {
     if(!lhs && !rhs) {
         return false;
@@ -29,6 +49,7 @@ Timer::Timer(uint64_t ms, std::function<void()> cb,
     , m_ms(ms)
     , m_cb(cb)
     , m_manager(manager) {
+    // 到期时间用精确时钟，缓存时钟在持续繁忙的线程上可能落后很多，会让定时器提前触发
     m_next = orange::GetCurrentMS() + m_ms;
 }
 
@@ -37,35 +58,66 @@ Timer::Timer(uint64_t next)
 }
 
 bool Timer::cancel() {
+    if(m_threadTimers) {
+        int state = ThreadTimers::ACTIVE;
+        if(!m_state.compare_exchange_strong(state, ThreadTimers::CANCELLED)) {
+            return false;
+        }
+        if(m_threadTimers->isOwner()) {
+            m_threadTimers->apply(shared_from_this(), ThreadTimers::CANCEL, 0, false);
+        } else {
+            m_threadTimers->post(shared_from_this(), ThreadTimers::CANCEL);
+        }
+        return true;
+    }
+
     TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
     if(!m_cb) {
         return false;
     }
     m_cb = nullptr;
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if(it == m_manager->m_timers.end()) {
-        return false;
-    }
-    m_manager->m_timers.erase(it);
-    return true;
+    return m_manager->eraseTimer(shared_from_this());
 }
 
 bool Timer::refresh() {
+    if(m_threadTimers) {
+        if(m_state != ThreadTimers::ACTIVE) {
+            return false;
+        }
+        if(m_threadTimers->isOwner()) {
+            m_threadTimers->apply(shared_from_this(), ThreadTimers::REFRESH, 0, false);
+        } else {
+            m_threadTimers->post(shared_from_this(), ThreadTimers::REFRESH);
+        }
+        return true;
+    }
+
     TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
     if(!m_cb) {
         return false;
     }
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if(it == m_manager->m_timers.end()) {
+    Timer::ptr self = shared_from_this();
+    if(!m_manager->eraseTimer(self)) {
         return false;
     }
-    m_manager->m_timers.erase(it);
     m_next = orange::GetCurrentMS() + m_ms;
-    m_manager->m_timers.insert(shared_from_this());
+    m_manager->insertTimer(self);
     return true;
 }
 
 bool Timer::reset(uint64_t ms, bool from_now) {
+    if(m_threadTimers) {
+        if(m_state != ThreadTimers::ACTIVE) {
+            return false;
+        }
+        if(m_threadTimers->isOwner()) {
+            m_threadTimers->apply(shared_from_this(), ThreadTimers::RESET, ms, from_now);
+        } else {
+            m_threadTimers->post(shared_from_this(), ThreadTimers::RESET, ms, from_now);
+        }
+        return true;
+    }
+
     if(ms == m_ms && !from_now) {
         return true;
     }
@@ -74,11 +126,10 @@ bool Timer::reset(uint64_t ms, bool from_now) {
     if(!m_cb) {
         return false;
     }
-    auto it = m_manager->m_timers.find(shared_from_this());
-    if(it == m_manager->m_timers.end()) {
+    Timer::ptr self = shared_from_this();
+    if(!m_manager->eraseTimer(self)) {
         return false;
     }
-    m_manager->m_timers.erase(it);
     uint64_t start;
     if(from_now) {
         start = orange::GetCurrentMS();
@@ -87,19 +138,386 @@ bool Timer::reset(uint64_t ms, bool from_now) {
     }
     m_ms = ms;
     m_next = start + ms;
-    m_manager->addTimer(shared_from_this(), lock);
+    m_manager->addTimer(self, lock);
     return true;
 }
 
+// TimerWheel
+TimerWheel::TimerWheel(uint64_t now_ms)
+    :m_current(now_ms) {
+    memset(m_slots, 0, sizeof(m_slots));
+    memset(m_bitmap, 0, sizeof(m_bitmap));
+}
+
+void TimerWheel::add(const Timer::ptr& timer) {
+    ORANGE_ASSERT(timer->m_wheelSlot == -1);
+    timer->m_wheelHold = timer;
+    link(timer.get(), slotOf(timer->m_next));
+    ++m_size;
+}
+
+Timer::ptr TimerWheel::remove(Timer* timer) {
+    if(timer->m_wheelSlot == -1) {
+        return nullptr;
+    }
+    unlink(timer);
+    --m_size;
+    return std::move(timer->m_wheelHold);
+}
+
+uint64_t TimerWheel::getNextExpire() const {
+    if(m_size == 0) {
+        return ~0ull;
+    }
+    // 第0层按槽位顺序(环形)找第一个非空的
+    uint64_t next = ~0ull;
+    int idx = m_current & (ROOT_SIZE - 1);
+    int slot = findSlot(idx, ROOT_SIZE);
+    if(slot == ROOT_SIZE) {
+        slot = findSlot(0, idx);
+        slot = slot == idx ? -1 : slot + ROOT_SIZE;
+    }
+    if(slot >= 0) {
+        next = m_current + slot - idx;
+    }
+
+    // 上层的槽位取下放的时间；当前下标的槽位，如果m_current正好在边界上还没下放就是现在，
+    // 否则要再转一圈
+    for(int level = 1; level < LEVELS; ++level) {
+        int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+        int base = ROOT_SIZE + (level - 1) * LEVEL_SIZE;
+        int cur = (m_current >> shift) & (LEVEL_SIZE - 1);
+        int first = (m_current & ((1ull << shift) - 1)) == 0 ? 0 : 1;
+        for(int i = first; i < first + LEVEL_SIZE; ++i) {
+            int s = base + ((cur + i) & (LEVEL_SIZE - 1));
+            if(m_slots[s]) {
+                uint64_t t = ((m_current >> shift) + i) << shift;
+                next = std::min(next, t);
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+void TimerWheel::expire(uint64_t now_ms, std::vector<Timer::ptr>& timers) {
+    while(m_current <= now_ms) {
+        if(m_size == 0) {
+            m_current = now_ms + 1;
+            break;
+        }
+        int idx = m_current & (ROOT_SIZE - 1);
+        if(idx == 0) {
+            cascade();
+        }
+        Timer* timer = takeSlot(idx);
+        while(timer) {
+            Timer* next = timer->m_wheelNext;
+            timer->m_wheelPrev = timer->m_wheelNext = nullptr;
+            timer->m_wheelSlot = -1;
+            --m_size;
+            timers.push_back(std::move(timer->m_wheelHold));
+            timer = next;
+        }
+
+        // 跳过本圈内的空槽位，不越过一圈的边界，边界处要下放上层的定时器
+        int step = findSlot(idx + 1, ROOT_SIZE) - idx;
+        if(m_current + step > now_ms + 1) {
+            m_current = now_ms + 1;
+            break;
+        }
+        m_current += step;
+    }
+}
+
+void TimerWheel::expireAll(uint64_t now_ms, std::vector<Timer::ptr>& timers) {
+    for(int i = 0; i < SLOTS; ++i) {
+        Timer* timer = takeSlot(i);
+        while(timer) {
+            Timer* next = timer->m_wheelNext;
+            timer->m_wheelPrev = timer->m_wheelNext = nullptr;
+            timer->m_wheelSlot = -1;
+            timers.push_back(std::move(timer->m_wheelHold));
+            timer = next;
+        }
+    }
+    m_size = 0;
+    m_current = now_ms + 1;
+}
+
+int TimerWheel::slotOf(uint64_t expire) const {
+    // 已经过期的放到下一个要处理的槽位
+    if(expire < m_current) {
+        expire = m_current;
+    }
+    uint64_t delta = expire - m_current;
+    if(delta < (uint64_t)ROOT_SIZE) {
+        return expire & (ROOT_SIZE - 1);
+    }
+    for(int level = 1; level < LEVELS; ++level) {
+        int shift = ROOT_BITS + level * LEVEL_BITS;
+        if(delta >= (1ull << shift)) {
+            if(level != LEVELS - 1) {
+                continue;
+            }
+            // 超出范围的先放在最高层最远处
+            expire = m_current + (1ull << shift) - 1;
+        }
+        int lshift = shift - LEVEL_BITS;
+        return ROOT_SIZE + (level - 1) * LEVEL_SIZE
+            + ((expire >> lshift) & (LEVEL_SIZE - 1));
+    }
+    return -1;
+}
+
+void TimerWheel::link(Timer* timer, int slot) {
+    timer->m_wheelSlot = slot;
+    timer->m_wheelPrev = nullptr;
+    timer->m_wheelNext = m_slots[slot];
+    if(m_slots[slot]) {
+        m_slots[slot]->m_wheelPrev = timer;
+    }
+    m_slots[slot] = timer;
+    m_bitmap[slot / 64] |= 1ull << (slot % 64);
+}
+
+void TimerWheel::unlink(Timer* timer) {
+    int slot = timer->m_wheelSlot;
+    if(timer->m_wheelPrev) {
+        timer->m_wheelPrev->m_wheelNext = timer->m_wheelNext;
+    } else {
+        m_slots[slot] = timer->m_wheelNext;
+    }
+    if(timer->m_wheelNext) {
+        timer->m_wheelNext->m_wheelPrev = timer->m_wheelPrev;
+    }
+    timer->m_wheelPrev = timer->m_wheelNext = nullptr;
+    timer->m_wheelSlot = -1;
+    if(!m_slots[slot]) {
+        m_bitmap[slot / 64] &= ~(1ull << (slot % 64));
+    }
+}
+
+Timer* TimerWheel::takeSlot(int slot) {
+    Timer* head = m_slots[slot];
+    m_slots[slot] = nullptr;
+    m_bitmap[slot / 64] &= ~(1ull << (slot % 64));
+    return head;
+}
+
+void TimerWheel::cascade() {
+    for(int level = 1; level < LEVELS; ++level) {
+        int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+        int idx = (m_current >> shift) & (LEVEL_SIZE - 1);
+        Timer* timer = takeSlot(ROOT_SIZE + (level - 1) * LEVEL_SIZE + idx);
+        while(timer) {
+            Timer* next = timer->m_wheelNext;
+            link(timer, slotOf(timer->m_next));
+            timer = next;
+        }
+        // 这一层也转完一圈才继续下放更上一层
+        if(idx != 0) {
+            break;
+        }
+    }
+}
+
+int TimerWheel::findSlot(int begin, int end) const {
+    while(begin < end) {
+        uint64_t bits = m_bitmap[begin / 64] >> (begin % 64);
+        if(bits) {
+            int slot = begin + __builtin_ctzll(bits);
+            return slot < end ? slot : end;
+        }
+        begin = (begin / 64 + 1) * 64;
+    }
+    return end;
+}
+
+// ThreadTimers
+ThreadTimers::ThreadTimers(TimerManager* manager, int thread)
+    :m_manager(manager)
+    ,m_thread(thread)
+    ,m_previousTime(orange::GetCurrentMS()) {
+}
+
+ThreadTimers::~ThreadTimers() {
+    drain();
+    for(auto& timer : m_heap) {
+        // 之后再cancel直接返回false，不再访问这里
+        timer->m_state = CANCELLED;
+        timer->m_heapIndex = -1;
+    }
+}
+
+bool ThreadTimers::isOwner() const {
+    return m_thread == orange::GetThreadId();
+}
+
+void ThreadTimers::add(const Timer::ptr& timer) {
+    timer->m_heapIndex = m_heap.size();
+    m_heap.push_back(timer);
+    siftUp(m_heap.size() - 1);
+}
+
+void ThreadTimers::remove(Timer* timer) {
+    size_t idx = timer->m_heapIndex;
+    size_t last = m_heap.size() - 1;
+    if(idx != last) {
+        swapAt(idx, last);
+    }
+    m_heap.back()->m_heapIndex = -1;
+    m_heap.pop_back();
+    if(idx < m_heap.size()) {
+        siftDown(idx);
+        siftUp(idx);
+    }
+}
+
+void ThreadTimers::apply(const Timer::ptr& timer, Op op, uint64_t ms, bool from_now) {
+    if(op == CANCEL) {
+        if(timer->m_heapIndex != -1) {
+            remove(timer.get());
+        }
+        timer->m_cb = nullptr;
+        return;
+    }
+    // 已经取消或者触发过
+    if(timer->m_heapIndex == -1 || timer->m_state != ACTIVE) {
+        return;
+    }
+    if(op == RESET && ms == timer->m_ms && !from_now) {
+        return;
+    }
+    remove(timer.get());
+    if(op == REFRESH) {
+        timer->m_next = orange::GetCurrentMS() + timer->m_ms;
+    } else {
+        uint64_t start = from_now ? orange::GetCurrentMS() : timer->m_next - timer->m_ms;
+        timer->m_ms = ms;
+        timer->m_next = start + ms;
+    }
+    add(timer);
+}
+
+void ThreadTimers::drain() {
+    Request* req = m_requests.exchange(nullptr, std::memory_order_acquire);
+    // 链表是后进先出的，翻转后按投递顺序执行
+    Request* head = nullptr;
+    while(req) {
+        Request* next = req->next;
+        req->next = head;
+        head = req;
+        req = next;
+    }
+    while(head) {
+        Request* next = head->next;
+        apply(head->timer, head->op, head->ms, head->from_now);
+        head->timer.reset();
+        ObjectPool<Request>::Free(head);
+        head = next;
+    }
+}
+
+uint64_t ThreadTimers::getNextExpire() const {
+    return m_heap.empty() ? ~0ull : m_heap[0]->m_next;
+}
+
+std::vector<Timer::ptr>& ThreadTimers::expire(uint64_t now_ms) {
+    bool rollover = now_ms < m_previousTime
+        && now_ms < (m_previousTime - 60 * 60 * 1000);
+    m_previousTime = now_ms;
+    while(!m_heap.empty() && (rollover || m_heap[0]->m_next <= now_ms)) {
+        m_expired.push_back(m_heap[0]);
+        remove(m_heap[0].get());
+    }
+    return m_expired;
+}
+
+void ThreadTimers::post(const Timer::ptr& timer, Op op, uint64_t ms, bool from_now) {
+    Request* req = ObjectPool<Request>::Alloc();
+    req->timer = timer;
+    req->op = op;
+    req->ms = ms;
+    req->from_now = from_now;
+    Request* head = m_requests.load(std::memory_order_relaxed);
+    do {
+        req->next = head;
+    } while(!m_requests.compare_exchange_weak(head, req
+                , std::memory_order_release, std::memory_order_relaxed));
+    // 取消不用唤醒，到期时发现已取消会跳过
+    if(op != CANCEL) {
+        m_manager->onThreadTimerChanged(m_thread);
+    }
+}
+
+void ThreadTimers::swapAt(size_t a, size_t b) {
+    std::swap(m_heap[a], m_heap[b]);
+    m_heap[a]->m_heapIndex = a;
+    m_heap[b]->m_heapIndex = b;
+}
+
+void ThreadTimers::siftUp(size_t idx) {
+    while(idx > 0) {
+        size_t parent = (idx - 1) / 2;
+        if(m_heap[parent]->m_next <= m_heap[idx]->m_next) {
+            break;
+        }
+        swapAt(parent, idx);
+        idx = parent;
+    }
+}
+
+void ThreadTimers::siftDown(size_t idx) {
+    size_t size = m_heap.size();
+    while(true) {
+        size_t min = idx;
+        size_t left = idx * 2 + 1;
+        size_t right = left + 1;
+        if(left < size && m_heap[left]->m_next < m_heap[min]->m_next) {
+            min = left;
+        }
+        if(right < size && m_heap[right]->m_next < m_heap[min]->m_next) {
+            min = right;
+        }
+        if(min == idx) {
+            break;
+        }
+        swapAt(idx, min);
+        idx = min;
+    }
+}
+
 // TimerManager
 TimerManager::TimerManager()
-    : m_previouseTime(orange::GetCurrentMS()) {}
+    : m_previouseTime(orange::GetCurrentMS()) {
+    if(g_timer_wheel->getValue()) {
+        m_wheel.reset(new TimerWheel(m_previouseTime));
+    }
+    m_perThread = g_timer_per_thread->getValue();
+    m_id = ++s_timer_manager_id;
+}
 
-TimerManager::~TimerManager() {}
+TimerManager::~TimerManager() {
+    if(m_wheel) {
+        // 释放轮中定时器对自己的引用
+        std::vector<Timer::ptr> timers;
+        m_wheel->expireAll(0, timers);
+    }
+    for(auto timers : m_threadTimers) {
+        delete timers;
+    }
+}
 
 Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb
                             ,bool recurring) {
     Timer::ptr timer(new Timer(ms, cb, recurring, this));
+    if(ThreadTimers* local = getThreadTimers(true)) {
+        // 当前线程正在运行，回到idle时会重新计算超时时间，不需要唤醒
+        timer->m_threadTimers = local;
+        local->add(timer);
+        return timer;
+    }
     RWMutexType::WriteLock lock(m_mutex);
     addTimer(timer, lock);
     return timer;
@@ -119,64 +537,175 @@ Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb
 }
 
 uint64_t TimerManager::getNextTimer() {
+    uint64_t next = ~0ull;
+    if(ThreadTimers* local = getThreadTimers(false)) {
+        local->drain();
+        next = local->getNextExpire();
+    }
     RWMutexType::ReadLock lock(m_mutex);
     m_tickled = false;
-    if(m_timers.empty()) {
+    if(m_wheel) {
+        next = std::min(next, m_wheel->getNextExpire());
+    } else if(!m_timers.empty()) {
+        next = std::min(next, (*m_timers.begin())->m_next);
+    }
+    if(next == ~0ull) {
         return ~0ull;
     }
-    const Timer::ptr timer = *m_timers.begin();
     uint64_t now_time = orange::GetCurrentMS();
-    if(now_time >= timer->m_next) {    
+    if(now_time >= next) {    
         return 0;
     } else {
-        return timer->m_next - now_time;
+        return next - now_time;
     }
 }
 
-void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
+uint64_t TimerManager::getNextThreadTimer() {
+    ThreadTimers* local = getThreadTimers(false);
+    if(!local) {
+        return ~0ull;
+    }
+    local->drain();
+    uint64_t next = local->getNextExpire();
+    if(next == ~0ull) {
+        return ~0ull;
+    }
     uint64_t now_time = orange::GetCurrentMS();
-    std::vector<Timer::ptr> expried;
+    return now_time >= next ? 0 : next - now_time;
+}
+
+void TimerManager::listThreadExpired(uint64_t now_ms, ExpiredSink& sink) {
+    ThreadTimers* local = getThreadTimers(false);
+    if(!local) {
+        return;
+    }
+    local->drain();
+    std::vector<Timer::ptr>& expired = local->expire(now_ms);
+    for(auto& timer : expired) {
+        if(timer->m_recurring) {
+            if(timer->m_state != ThreadTimers::ACTIVE) {
+                timer->m_cb = nullptr;
+                continue;
+            }
+            // 循环定时器还要用，只能拷贝
+            std::function<void()> cb(timer->m_cb);
+            sink.add(cb);
+            timer->m_next = now_ms + timer->m_ms;
+            local->add(timer);
+            continue;
+        }
+        // 和其他线程的cancel竞争，成功置为DONE才执行
+        int state = ThreadTimers::ACTIVE;
+        if(timer->m_state.compare_exchange_strong(state, ThreadTimers::DONE)) {
+            sink.add(timer->m_cb);
+        }
+        timer->m_cb = nullptr;
+    }
+    expired.clear();
+}
+
+namespace {
+
+// 收集到数组中，兼容原来的接口
+class VectorSink : public TimerManager::ExpiredSink {
+public:
+    VectorSink(std::vector<std::function<void()>>& cbs)
+        :m_cbs(cbs) {
+    }
+
+    void add(std::function<void()>& cb) override {
+        m_cbs.push_back(std::move(cb));
+    }
+
+private:
+    std::vector<std::function<void()>>& m_cbs;
+};
+
+}
+
+void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
+    VectorSink sink(cbs);
+    listExpired(sink);
+}
+
+void TimerManager::listExpired(ExpiredSink& sink) {
+    // 事件循环刚刷新过缓存时钟，落后时只会让定时器晚一点触发
+    uint64_t now_time = orange::GetCachedMS();
+    listThreadExpired(now_time, sink);
+
     {
         RWMutexType::ReadLock lock(m_mutex);
-        if(m_timers.empty()) {
+        if(m_wheel ? m_wheel->empty() : m_timers.empty()) {
             return;
         }
     }
 
     RWMutexType::WriteLock lock(m_mutex);
-    bool rollover = detectClockRollover(now_time);
-    if(!rollover && now_time < (*m_timers.begin())->m_next) {
-        return;
-    }
+    bool rollover = false;
+    if(m_wheel) {
+        if(m_wheel->empty()) {
+            return;
+        }
+        rollover = detectClockRollover(now_time);
+        if(rollover) {
+            m_wheel->expireAll(now_time, m_expired);
+        } else {
+            m_wheel->expire(now_time, m_expired);
+        }
+    } else {
+        // 读锁释放后可能已被其他线程取空
+        if(m_timers.empty()) {
+            return;
+        }
+        rollover = detectClockRollover(now_time);
+        if(!rollover && now_time < (*m_timers.begin())->m_next) {
+            return;
+        }
 
-    Timer::ptr now_timer(new Timer(now_time));
-    auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer); // 时间变动，全部触发
-    while(it != m_timers.end() && (*it)->m_next == now_time) {
-        ++it;
+        Timer::ptr now_timer(new Timer(now_time));
+        auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer); // 时间变动，全部触发
+        while(it != m_timers.end() && (*it)->m_next == now_time) {
+            ++it;
+        }
+        m_expired.insert(m_expired.end(), m_timers.begin(), it);
+        m_timers.erase(m_timers.begin(), it);
     }
-    expried.insert(expried.begin(), m_timers.begin(), it);
-    m_timers.erase(m_timers.begin(), it);
-    cbs.reserve(expried.size());
 
-    for(auto& timer : expried) {
-        cbs.push_back(timer->m_cb);
+    for(auto& timer : m_expired) {
         if(timer->m_recurring) {
+            // 循环定时器还要用，只能拷贝
+            std::function<void()> cb(timer->m_cb);
+            sink.add(cb);
             timer->m_next = now_time + timer->m_ms;
-            m_timers.insert(timer);
+            insertTimer(timer);
         } else {
-            timer->m_cb = nullptr; // 防止cb里存在智能指针无法稀释
+            // 回调移交给sink，定时器里不再持有(防止cb里存在智能指针无法释放)
+            sink.add(timer->m_cb);
+            timer->m_cb = nullptr;
         }
     }
+    m_expired.clear();
 }
 
 bool TimerManager::hasTimer() {
+    ThreadTimers* local = getThreadTimers(false);
+    if(local && !local->empty()) {
+        return true;
+    }
     RWMutexType::ReadLock lock(m_mutex);
-    return !m_timers.empty();
+    return m_wheel ? !m_wheel->empty() : !m_timers.empty();
 }
 
 void TimerManager::addTimer(Timer::ptr timer, RWMutexType::WriteLock& lock) {
-    auto it = m_timers.insert(timer).first;
-    bool at_front = (it == m_timers.begin() && !m_tickled);
+    bool at_front = false;
+    if(m_wheel) {
+        // 时间轮只知道最早的下放时间，比它早就需要唤醒
+        at_front = timer->m_next < m_wheel->getNextExpire() && !m_tickled;
+        m_wheel->add(timer);
+    } else {
+        auto it = m_timers.insert(timer).first;
+        at_front = (it == m_timers.begin() && !m_tickled);
+    }
 
     if(at_front) {
         m_tickled = true;
@@ -189,6 +718,46 @@ void TimerManager::addTimer(Timer::ptr timer, RWMutexType::WriteLock& lock) {
     }
 }
 
+void TimerManager::insertTimer(const Timer::ptr& timer) {
+    if(m_wheel) {
+        m_wheel->add(timer);
+    } else {
+        m_timers.insert(timer);
+    }
+}
+
+bool TimerManager::eraseTimer(const Timer::ptr& timer) {
+    if(m_wheel) {
+        return m_wheel->remove(timer.get()) != nullptr;
+    }
+    auto it = m_timers.find(timer);
+    if(it == m_timers.end()) {
+        return false;
+    }
+    m_timers.erase(it);
+    return true;
+}
+
+ThreadTimers* TimerManager::getThreadTimers(bool create) {
+    if(!m_perThread) {
+        return nullptr;
+    }
+    if(t_timers_owner == m_id) {
+        return t_thread_timers;
+    }
+    if(!create || !canOwnTimers()) {
+        return nullptr;
+    }
+    ThreadTimers* timers = new ThreadTimers(this, orange::GetThreadId());
+    {
+        RWMutexType::WriteLock lock(m_mutex);
+        m_threadTimers.push_back(timers);
+    }
+    t_timers_owner = m_id;
+    t_thread_timers = timers;
+    return timers;
+}
+
 bool TimerManager::detectClockRollover(uint64_t now_ms) {
     bool rollover = false;
     if(now_ms < m_previouseTime &&
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <vector>
@@ -10,9 +11,13 @@
 namespace orange {
 
 class TimerManager;
+class TimerWheel;
+class ThreadTimers;
 
 class Timer : public std::enable_shared_from_this<Timer> {
 friend class TimerManager;
+friend class TimerWheel;
+friend class ThreadTimers;
 public:
     typedef std::shared_ptr<Timer> ptr;
 
@@ -33,16 +38,152 @@ private:
     std::function<void()> m_cb;
     TimerManager* m_manager = nullptr;
 
+    // 时间轮模式下挂在槽位的双向链表上，在轮中时持有自己
+    Timer::ptr m_wheelHold;
+    Timer* m_wheelPrev = nullptr;
+    Timer* m_wheelNext = nullptr;
+    int m_wheelSlot = -1;
+
+    // 放在线程自己的堆里时指向它，nullptr表示在共享存储中
+    ThreadTimers* m_threadTimers = nullptr;
+    int m_heapIndex = -1;
+    // 线程定时器的状态，可被其他线程cancel，取值为ThreadTimers::State
+    std::atomic<int> m_state = {0};
+
 private:
     struct Comparator {
         bool operator()(const Timer::ptr& lhs, const Timer::ptr& rhs) const;
     };
 };
 
+/*
+* 分层时间轮，精度1ms，添加、删除O(1)
+* 第0层256个槽，每槽1ms；第1~3层各64个槽，每槽是下一层一圈的时间，
+* 共覆盖2^26ms(约18.6小时)，更远的定时器先放在最高层，转到时再重新放置
+* 不加锁，由TimerManager在锁内调用
+*/
+class TimerWheel {
+public:
+    TimerWheel(uint64_t now_ms);
+
+    void add(const Timer::ptr& timer);
+    // 不在轮中返回nullptr
+    Timer::ptr remove(Timer* timer);
+    // 最早可能到期的时间，可能早于实际到期时间(高层的槽只知道何时下放)，为空返回~0ull
+    uint64_t getNextExpire() const;
+    // 取出now_ms及之前到期的定时器
+    void expire(uint64_t now_ms, std::vector<Timer::ptr>& timers);
+    // 全部取出，时钟回拨时使用
+    void expireAll(uint64_t now_ms, std::vector<Timer::ptr>& timers);
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+private:
+    static const int ROOT_BITS = 8;
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int LEVEL_BITS = 6;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int LEVELS = 4;
+    static const int SLOTS = ROOT_SIZE + (LEVELS - 1) * LEVEL_SIZE;
+
+    // expire应放入的槽位
+    int slotOf(uint64_t expire) const;
+    void link(Timer* timer, int slot);
+    void unlink(Timer* timer);
+    // 取下整个槽位的链表
+    Timer* takeSlot(int slot);
+    // 第0层转完一圈时，把上层当前槽位的定时器放到下层
+    void cascade();
+    // [begin, end)中第一个非空的槽位，没有返回end
+    int findSlot(int begin, int end) const;
+
+private:
+    Timer* m_slots[SLOTS];
+    uint64_t m_bitmap[SLOTS / 64];
+    // 下一个要处理的时刻
+    uint64_t m_current = 0;
+    size_t m_size = 0;
+};
+
+/*
+* 线程自己的定时器小根堆，只由所属线程操作，不加锁
+* 其他线程的cancel/refresh/reset通过无锁链表投递，所属线程处理定时器前统一执行
+*/
+class ThreadTimers {
+public:
+    enum State {
+        ACTIVE = 0,
+        CANCELLED = 1,
+        // 非循环定时器已经触发
+        DONE = 2
+    };
+
+    enum Op {
+        CANCEL,
+        REFRESH,
+        RESET
+    };
+
+    ThreadTimers(TimerManager* manager, int thread);
+    ~ThreadTimers();
+
+    int getThread() const { return m_thread; }
+    bool isOwner() const;
+
+    // 以下只能由所属线程调用
+    void add(const Timer::ptr& timer);
+    void remove(Timer* timer);
+    // 执行op，timer已不在堆中时忽略
+    void apply(const Timer::ptr& timer, Op op, uint64_t ms, bool from_now);
+    // 执行其他线程投递来的操作
+    void drain();
+    uint64_t getNextExpire() const;
+    // 取出now_ms及之前到期的定时器，时钟回拨时全部取出
+    // 返回的数组由调用方用完后clear，保留容量下次复用
+    std::vector<Timer::ptr>& expire(uint64_t now_ms);
+    bool empty() const { return m_heap.empty(); }
+
+    // 其他线程调用
+    void post(const Timer::ptr& timer, Op op, uint64_t ms = 0, bool from_now = false);
+
+private:
+    // 投递的操作，由ObjectPool复用
+    struct Request {
+        Timer::ptr timer;
+        Op op = CANCEL;
+        uint64_t ms = 0;
+        bool from_now = false;
+        Request* next = nullptr;
+    };
+
+    void swapAt(size_t a, size_t b);
+    void siftUp(size_t idx);
+    void siftDown(size_t idx);
+
+private:
+    TimerManager* m_manager;
+    int m_thread;
+    std::vector<Timer::ptr> m_heap;
+    std::atomic<Request*> m_requests = {nullptr};
+    uint64_t m_previousTime = 0;
+    std::vector<Timer::ptr> m_expired;
+};
+
 class TimerManager {
 friend class Timer;
+friend class ThreadTimers;
 public:
     typedef RWMutex RWMutexType;
+
+    // 接收到期定时器的回调
+    class ExpiredSink {
+    public:
+        virtual ~ExpiredSink() {}
+        // 可以直接移走cb，不需要拷贝
+        virtual void add(std::function<void()>& cb) = 0;
+    };
+
     TimerManager();
     virtual ~TimerManager();
 
@@ -52,19 +193,46 @@ public:
                                 , std::weak_ptr<void> weak_cond
                                 , bool recurring = false);
 
+    // 包括当前线程自己的定时器
     uint64_t getNextTimer();
+    // 只看当前线程自己的定时器
+    uint64_t getNextThreadTimer();
+    // 包括当前线程自己到期的定时器
     void listExpiredCb(std::vector<std::function<void()>>& cbs);
+    // 同上，回调直接交给sink，非循环定时器的回调是移动过去的
+    void listExpired(ExpiredSink& sink);
     bool hasTimer();
 protected:
     virtual void onTimerInsertAtFront() = 0;
+    // 当前线程能否持有自己的定时器，需要线程会定期处理定时器
+    virtual bool canOwnTimers() { return false; }
+    // 其他线程refresh/reset了thread的定时器，它可能需要提前醒来
+    virtual void onThreadTimerChanged(int thread) {}
     void addTimer(Timer::ptr timer, RWMutexType::WriteLock& lock);
 
 private:
     bool detectClockRollover(uint64_t now_ms);
+    // 以下两个需要持有写锁，不检查是否在最前面
+    void insertTimer(const Timer::ptr& timer);
+    // 不在管理器中返回false
+    bool eraseTimer(const Timer::ptr& timer);
+    // 开启按线程存放且当前线程可以持有定时器时返回当前线程的堆，create为false时不创建
+    ThreadTimers* getThreadTimers(bool create);
+    // 取出当前线程自己到期的定时器
+    void listThreadExpired(uint64_t now_ms, ExpiredSink& sink);
 
 private:
     RWMutexType m_mutex;
     std::set<Timer::ptr, Timer::Comparator> m_timers;
+    // 非空时使用时间轮代替m_timers，构造时从配置读取
+    std::unique_ptr<TimerWheel> m_wheel;
+    // 按线程存放定时器，构造时从配置读取
+    bool m_perThread = false;
+    // 区分管理器，线程缓存的堆属于哪个管理器
+    uint64_t m_id = 0;
+    std::vector<ThreadTimers*> m_threadTimers;
+    // 到期定时器的临时数组，持有写锁时使用，保留容量
+    std::vector<Timer::ptr> m_expired;
     bool m_tickled = false;
     uint64_t m_previouseTime = 0;
 };
@@ -56,18 +56,49 @@ std::string BacktraceToString(int size, int skip, const std::string prefix) {
     return ss.str();
 }
 
+// 0表示本线程没有开启缓存时钟
+static thread_local uint64_t t_cached_us = 0;
+static thread_local uint64_t t_clock_reads = 0;
+
 uint64_t GetCurrentMS() {
+    ++t_clock_reads;
     struct timeval tv;
     gettimeofday(&tv, NULL);
     return tv.tv_sec * 1000ul + tv.tv_usec / 1000;
 }
 
 uint64_t GetCurrentUS() {
+    ++t_clock_reads;
     struct timeval tv;
     gettimeofday(&tv, NULL);
     return tv.tv_sec * 1000 * 1000ul + tv.tv_usec;
 }
 
+uint64_t GetCachedMS() {
+    return t_cached_us ? t_cached_us / 1000 : GetCurrentMS();
+}
+
+time_t GetCachedSeconds() {
+    if(t_cached_us) {
+        return t_cached_us / 1000000;
+    }
+    ++t_clock_reads;
+    return time(0);
+}
+
+uint64_t UpdateCachedClock() {
+    t_cached_us = GetCurrentUS();
+    return t_cached_us;
+}
+
+void DisableCachedClock() {
+    t_cached_us = 0;
+}
+
+uint64_t GetClockReads() {
+    return t_clock_reads;
+}
+
 std::string Time2Str(time_t ts, const std::string& format) {
     struct tm tm;
     localtime_r(&ts, &tm);
@@ -20,6 +20,20 @@ uint64_t GetCurrentMS();
 
 uint64_t GetCurrentUS();
 
+// 事件循环每轮刷新一次的缓存时钟，定时器和日志用它代替每次读系统时钟
+// 本线程没有开启缓存时等同于GetCurrentMS()/time(0)
+uint64_t GetCachedMS();
+
+time_t GetCachedSeconds();
+
+// 开启本线程的缓存时钟并刷新，返回当前时间(us)
+uint64_t UpdateCachedClock();
+
+void DisableCachedClock();
+
+// 本线程读取系统时钟的次数
+uint64_t GetClockReads();
+
 std::string Time2Str(time_t ts = time(0), const std::string& format = "%Y-%m-%d %H:%M:%S");
 
 class FSUtil {
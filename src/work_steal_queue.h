@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "noncopyable.h"
+
+namespace orange {
+
+/*
+* Chase-Lev 有界双端队列
+* push/pop 只能由owner线程调用(bottom端)，steal可以由任意线程调用(top端)
+*/
+template<class T>
+class WorkStealQueue : Noncopyable {
+public:
+    WorkStealQueue(size_t capacity = 1024) {
+        size_t cap = 2;
+        while(cap < capacity) {
+            cap <<= 1;
+        }
+        m_mask = cap - 1;
+        m_buffer = std::vector<std::atomic<T*>>(cap);
+    }
+
+    // 队列满时返回false，由调用方放入全局队列
+    bool push(T* v) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        if(b - t > (int64_t)m_mask) {
+            return false;
+        }
+        m_buffer[b & m_mask].store(v, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    T* pop() {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        if(t > b) {
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T* v = m_buffer[b & m_mask].load(std::memory_order_relaxed);
+        if(t == b) {
+            // 最后一个元素，和steal竞争
+            if(!m_top.compare_exchange_strong(t, t + 1
+                        , std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                v = nullptr;
+            }
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return v;
+    }
+
+    T* steal() {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if(t >= b) {
+            return nullptr;
+        }
+        T* v = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+        if(!m_top.compare_exchange_strong(t, t + 1
+                    , std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return v;
+    }
+
+    size_t size() const {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    alignas(64) std::atomic<int64_t> m_top = {0};
+    alignas(64) std::atomic<int64_t> m_bottom = {0};
+    size_t m_mask = 0;
+    std::vector<std::atomic<T*>> m_buffer;
+};
+
+} // namespace orange
@@ -0,0 +1,108 @@
+#include "src/orange.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+/*
+* 一个协程写大文件并fsync，再用copy_file_range复制一份，同一个工作线程上的另一个协程每1ms醒来一次，
+* 比较开启阻塞线程池前后它的最大唤醒间隔
+* usage: test_blocking_pool [写入MB]
+*/
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const char* s_path = "blocking_pool.dat";
+static const char* s_copy_path = "blocking_pool.copy";
+static std::atomic<bool> s_writing = {false};
+static std::atomic<bool> s_done = {false};
+
+void writer(size_t mb) {
+    std::string buf(4 * 1024 * 1024, 'w');
+    uint64_t begin = orange::GetCurrentUS();
+    int fd = open(s_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if(fd < 0) {
+        ORANGE_LOG_ERROR(g_logger) << "open errno=" << errno;
+        s_writing = false;
+        return;
+    }
+    for(size_t i = 0; i < mb; i += 4) {
+        if(write(fd, &buf[0], buf.size()) != (ssize_t)buf.size() || fsync(fd)) {
+            ORANGE_LOG_ERROR(g_logger) << "write errno=" << errno;
+            break;
+        }
+    }
+    close(fd);
+    ORANGE_LOG_INFO(g_logger) << "  write+fsync " << mb << "MB used="
+        << (orange::GetCurrentUS() - begin) / 1000 << "ms";
+
+    begin = orange::GetCurrentUS();
+    int in = open(s_path, O_RDONLY);
+    int out = open(s_copy_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    size_t copied = 0;
+    while(in >= 0 && out >= 0) {
+        ssize_t rt = copy_file_range(in, nullptr, out, nullptr, 4 * 1024 * 1024, 0);
+        if(rt <= 0) {
+            if(rt < 0) {
+                ORANGE_LOG_ERROR(g_logger) << "copy_file_range errno=" << errno;
+            }
+            break;
+        }
+        copied += rt;
+    }
+    if(in >= 0 && out >= 0) {
+        fsync(out);
+    }
+    close(in);
+    close(out);
+    ORANGE_LOG_INFO(g_logger) << "  copy_file_range+fsync " << copied / 1024 / 1024
+        << "MB used=" << (orange::GetCurrentUS() - begin) / 1000 << "ms";
+    s_writing = false;
+}
+
+// 写文件期间每1ms醒一次，统计唤醒间隔
+void ticker() {
+    uint64_t max_gap = 0;
+    uint64_t ticks = 0;
+    uint64_t last = orange::GetCurrentUS();
+    while(s_writing) {
+        usleep(1000);
+        uint64_t now = orange::GetCurrentUS();
+        max_gap = std::max(max_gap, now - last);
+        last = now;
+        ++ticks;
+    }
+    ORANGE_LOG_INFO(g_logger) << "  ticker ticks=" << ticks
+        << " max_gap=" << max_gap / 1000 << "ms";
+    s_done = true;
+}
+
+void bench(uint32_t threads, size_t mb) {
+    orange::Config::Lookup<uint32_t>("blocking_pool.threads")->setValue(threads);
+    ORANGE_LOG_INFO(g_logger) << "blocking_pool.threads=" << threads;
+    s_writing = true;
+    s_done = false;
+    orange::IOManager iom(1, false, "disk");
+    iom.schedule(&ticker);
+    iom.schedule(std::bind(&writer, mb));
+    while(!s_done) {
+        usleep(1000);
+    }
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    size_t mb = argc > 1 ? atoi(argv[1]) : 64;
+    bench(0, mb);
+    bench(2, mb);
+    bench(0, mb);
+    bench(2, mb);
+    unlink(s_path);
+    unlink(s_copy_path);
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "src/orange.h"
+#include "src/fd_manager.h"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+orange::Logger::ptr g_access = ORANGE_LOG_NAME("access");
+
+static const int s_requests = 20000;
+
+// 每个请求：带超时的读(加一个定时器)、写一行访问日志、回写
+void serve(int fd) {
+    timeval tv = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char c;
+    while(recv(fd, &c, 1, 0) == 1) {
+        ORANGE_LOG_INFO(g_access) << "fd=" << fd << " request";
+        if(send(fd, &c, 1, 0) != 1) {
+            break;
+        }
+    }
+    close(fd);
+}
+
+// 工作线程读系统时钟的次数
+uint64_t worker_clock_reads(orange::IOManager& iom) {
+    std::atomic<int64_t> result = {-1};
+    iom.schedule([&result]() {
+        result = orange::GetClockReads();
+    });
+    while(result < 0) {
+        usleep(100);
+    }
+    return result;
+}
+
+void bench(bool cached) {
+    orange::Config::Lookup<bool>("iomanager.cached_clock")->setValue(cached);
+    orange::IOManager iom(1, false, "clock");
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+        ORANGE_LOG_ERROR(g_logger) << "socketpair errno=" << errno;
+        return;
+    }
+    // socketpair没有hook，手动登记为socket
+    orange::FdMrg::GetInstance()->get(fds[1], true);
+    int fd = fds[1];
+    iom.schedule([fd]() { serve(fd); });
+
+    uint64_t reads = worker_clock_reads(iom);
+    uint64_t begin = orange::GetCurrentUS();
+    std::thread client([&fds]() {
+        char c = 'r';
+        for(int i = 0; i < s_requests; ++i) {
+            if(write(fds[0], &c, 1) != 1 || read(fds[0], &c, 1) != 1) {
+                ORANGE_LOG_ERROR(g_logger) << "client errno=" << errno;
+                break;
+            }
+        }
+    });
+    client.join();
+    uint64_t used = orange::GetCurrentUS() - begin;
+    // 查询任务本身也要经过一轮循环，误差可以忽略
+    reads = worker_clock_reads(iom) - reads;
+    close(fds[0]);
+
+    ORANGE_LOG_INFO(g_logger) << (cached ? "cached " : "precise")
+        << " requests=" << s_requests
+        << " clock_reads=" << reads
+        << " reads/request=" << (double)reads / s_requests
+        << " req/s=" << (uint64_t)(s_requests * 1000000.0 / used);
+}
+
+/*
+* 工作线程一直忙、缓存时钟没有刷新时设置的定时器不能提前触发：
+* 先忙300ms再sleep 100ms，实际睡眠不能少于100ms
+*/
+void test_stale_cache() {
+    orange::Config::Lookup<bool>("iomanager.cached_clock")->setValue(true);
+    std::atomic<int64_t> slept = {-1};
+    {
+        orange::IOManager iom(1, false, "stale");
+        iom.schedule([&slept]() {
+            // 先经过一轮事件循环，让本线程开启缓存时钟
+            usleep(10 * 1000);
+            uint64_t busy_end = orange::GetCurrentMS() + 300;
+            while(orange::GetCurrentMS() < busy_end);
+            uint64_t begin = orange::GetCurrentMS();
+            usleep(100 * 1000);
+            slept = orange::GetCurrentMS() - begin;
+        });
+    }
+    ORANGE_LOG_INFO(g_logger) << "stale cached clock: usleep(100ms) slept=" << slept << "ms "
+        << (slept >= 100 ? "ok" : "FIRED EARLY");
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    // 访问日志写到/dev/null，只看取时间的开销
+    g_access->addAppender(orange::LogAppender::ptr(new orange::FileLogAppender("/dev/null")));
+    bench(false);
+    bench(true);
+    bench(false);
+    bench(true);
+    test_stale_cache();
+    return 0;
+}
@@ -0,0 +1,278 @@
+#include "src/orange.h"
+#include "src/channel.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+
+/*
+* 通道的关闭语义、无界模式、select的检查，
+* 以及SPSC、MPSC、MPMC的吞吐(msgs/sec)，生产者和消费者在不同的IOManager上
+*/
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const int s_msg_count = 400000;
+static int s_failed = 0;
+
+#define CHECK(cond) \
+    if(!(cond)) { \
+        ++s_failed; \
+        ORANGE_LOG_ERROR(g_logger) << "check fail: " #cond; \
+    }
+
+template<class ChannelType>
+void test_close(const char* name) {
+    ChannelType chan(2);
+    int v = 0;
+    CHECK(chan.push(1));
+    CHECK(chan.tryPush(2));
+    CHECK(!chan.tryPush(3));
+    chan.close();
+    CHECK(chan.isClosed());
+    CHECK(!chan.push(4));
+    CHECK(chan.pop(v) && v == 1);
+    CHECK(chan.tryPop(v) && v == 2);
+    CHECK(!chan.pop(v));
+
+    // 挂起的接收方和发送方都被关闭唤醒
+    ChannelType empty(1);
+    ChannelType full(1);
+    full.push(0);
+    std::atomic<int> woken = {0};
+    {
+        orange::IOManager iom(1, false, "close");
+        iom.schedule([&empty, &woken]() {
+            int v = 0;
+            if(!empty.pop(v)) {
+                ++woken;
+            }
+        });
+        iom.schedule([&full, &woken]() {
+            if(!full.push(1)) {
+                ++woken;
+            }
+        });
+        iom.schedule([&empty, &full]() {
+            usleep(10 * 1000);
+            empty.close();
+            full.close();
+        });
+    }
+    CHECK(woken == 2);
+    ORANGE_LOG_INFO(g_logger) << name << " close ok";
+}
+
+/*
+* 消费者在生产者push的同时关闭通道：push成功的数据必须都能取到，
+* 不能出现push返回true、pop却已经因为关闭返回false的情况
+*/
+template<class ChannelType>
+void test_close_race(const char* name) {
+    static const int s_rounds = 500;
+    int lost = 0;
+    orange::FiberWaitGroup wg;
+    {
+        orange::IOManager prod(1, false, "prod");
+        orange::IOManager cons(1, false, "cons");
+        for(int r = 0; r < s_rounds; ++r) {
+            ChannelType chan(8);
+            int pushed = 0;
+            int popped = 0;
+            wg.add(2);
+            prod.schedule([&chan, &pushed, &wg]() {
+                while(chan.push(pushed)) {
+                    ++pushed;
+                }
+                wg.done();
+            });
+            cons.schedule([&chan, &popped, &wg, r]() {
+                int v = 0;
+                for(int i = 0; i < r % 50 && chan.pop(v); ++i) {
+                    ++popped;
+                }
+                chan.close();
+                while(chan.pop(v)) {
+                    ++popped;
+                }
+                wg.done();
+            });
+            wg.wait();
+            lost += pushed - popped;
+        }
+    }
+    CHECK(lost == 0);
+    ORANGE_LOG_INFO(g_logger) << name << " close race ok: rounds=" << s_rounds
+        << " lost=" << lost;
+}
+
+void test_unbounded() {
+    orange::Channel<std::string> chan;
+    for(int i = 0; i < 10000; ++i) {
+        CHECK(chan.push(std::to_string(i)));
+    }
+    CHECK(chan.size() == 10000);
+    std::string v;
+    CHECK(chan.pop(v) && v == "0");
+}
+
+// 两个调度器上的生产者，select同时接收，再从select发出去
+void test_select() {
+    orange::Channel<int> a(4);
+    orange::SpscChannel<int> b(4);
+    orange::Channel<int> out(1);
+    int64_t sum = 0;
+    int got_a = 0;
+    int got_b = 0;
+    // 调度器停止时不等挂起的协程，要等它们都结束
+    orange::FiberWaitGroup wg;
+    wg.add(3);
+    {
+        orange::IOManager iom1(1, false, "sel1");
+        orange::IOManager iom2(1, false, "sel2");
+        iom1.schedule([&a, &wg]() {
+            for(int i = 1; i <= 1000; ++i) {
+                a.push(i);
+            }
+            a.close();
+            wg.done();
+        });
+        iom2.schedule([&b, &wg]() {
+            for(int i = 1; i <= 1000; ++i) {
+                b.push(i);
+            }
+            b.close();
+            wg.done();
+        });
+        iom1.schedule([&]() {
+            bool a_open = true;
+            bool b_open = true;
+            while(a_open || b_open) {
+                int va = 0;
+                int vb = 0;
+                bool ok = false;
+                orange::Select sel;
+                int ia = a_open ? sel.recv(a, va, &ok) : -1;
+                int ib = b_open ? sel.recv(b, vb, &ok) : -1;
+                int i = sel.wait();
+                if(i == ia) {
+                    a_open = ok;
+                    got_a += ok;
+                    sum += va;
+                } else if(i == ib) {
+                    b_open = ok;
+                    got_b += ok;
+                    sum += vb;
+                }
+            }
+            // out满了，发送分支不就绪，走default
+            out.push(0);
+            orange::Select sel;
+            sel.send(out, 1);
+            CHECK(sel.tryWait() == -1);
+            out.close();
+            bool ok = true;
+            CHECK(sel.wait() == 0);
+            orange::Select sel2;
+            sel2.send(out, 1, &ok);
+            CHECK(sel2.wait() == 0 && !ok);
+            wg.done();
+        });
+        wg.wait();
+    }
+    CHECK(got_a == 1000 && got_b == 1000);
+    CHECK(sum == 2 * 500500);
+    ORANGE_LOG_INFO(g_logger) << "select ok: a=" << got_a << " b=" << got_b;
+}
+
+/*
+* producers个生产者在一个IOManager上，consumers个消费者在另一个上
+* 生产者都结束后关闭通道，消费者取到pop失败为止
+*/
+template<class ChannelType>
+void bench(const char* name, ChannelType& chan, int threads, int producers, int consumers) {
+    int per_producer = s_msg_count / producers;
+    std::atomic<int64_t> sum = {0};
+    std::atomic<int> received = {0};
+    orange::FiberWaitGroup producing;
+    orange::FiberWaitGroup consuming;
+    producing.add(producers);
+    consuming.add(consumers);
+    uint64_t begin = orange::GetCurrentUS();
+    {
+        orange::IOManager prod(threads, false, "prod");
+        orange::IOManager cons(threads, false, "cons");
+        for(int i = 0; i < consumers; ++i) {
+            cons.schedule([&chan, &sum, &received, &consuming]() {
+                int64_t local = 0;
+                int count = 0;
+                int v = 0;
+                while(chan.pop(v)) {
+                    local += v;
+                    ++count;
+                }
+                sum += local;
+                received += count;
+                consuming.done();
+            });
+        }
+        for(int i = 0; i < producers; ++i) {
+            prod.schedule([&chan, &producing, per_producer]() {
+                for(int j = 0; j < per_producer; ++j) {
+                    chan.push(j);
+                }
+                producing.done();
+            });
+        }
+        producing.wait();
+        chan.close();
+        consuming.wait();
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    int total = per_producer * producers;
+    CHECK(received == total);
+    CHECK(sum == (int64_t)producers * per_producer * (per_producer - 1) / 2);
+    ORANGE_LOG_INFO(g_logger) << name << " msgs=" << total
+        << " msgs/sec=" << (uint64_t)(total * 1000000.0 / used);
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::FATAL);
+
+    test_close<orange::Channel<int> >("Channel");
+    test_close<orange::SpscChannel<int> >("SpscChannel");
+    test_close_race<orange::Channel<int> >("Channel");
+    test_close_race<orange::SpscChannel<int> >("SpscChannel");
+    test_unbounded();
+    test_select();
+
+    {
+        orange::SpscChannel<int> chan(1024);
+        bench("SPSC SpscChannel(1024)   ", chan, 1, 1, 1);
+    }
+    {
+        orange::Channel<int> chan(1024);
+        bench("SPSC Channel(1024)       ", chan, 1, 1, 1);
+    }
+    {
+        orange::Channel<int> chan(1024);
+        bench("MPSC Channel(1024) 4:1   ", chan, 1, 4, 1);
+    }
+    {
+        orange::Channel<int> chan(1024);
+        bench("MPMC Channel(1024) 4:4   ", chan, 1, 4, 4);
+    }
+    {
+        orange::Channel<int> chan(1024);
+        bench("MPMC Channel(1024) 4:4 2t", chan, 2, 4, 4);
+    }
+    {
+        orange::Channel<int> chan;
+        bench("MPMC Channel(unbounded)  ", chan, 1, 4, 4);
+    }
+
+    ORANGE_LOG_INFO(g_logger) << (s_failed ? "FAILED" : "ALL OK") << " failed=" << s_failed;
+    return s_failed ? 1 : 0;
+}
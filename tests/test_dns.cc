@@ -0,0 +1,256 @@
+#include "src/orange.h"
+#include "src/address.h"
+#include "src/dns.h"
+#include "src/socket.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+* 本地的DNS桩服务器从hosts文件应答，验证解析、TTL过期、不存在域名的缓存，
+* 并比较缓存命中、未命中和getaddrinfo的耗时
+*/
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const char* s_hosts_path = "/tmp/orange_dns_hosts";
+static const char* s_stub_addr = "127.0.0.1:5353";
+static const char* s_silent_addr = "127.0.0.1:5354";
+static const uint32_t s_ttl = 1;
+
+static std::unordered_map<std::string, std::vector<orange::IPAddress::ptr> > s_hosts;
+static std::atomic<uint64_t> s_stub_queries = {0};
+static int s_failed = 0;
+
+#define CHECK(cond) \
+    if(!(cond)) { \
+        ++s_failed; \
+        ORANGE_LOG_ERROR(g_logger) << "check fail: " #cond; \
+    }
+
+static void put_u16(std::string& buf, uint16_t v) {
+    buf.push_back((char)(v >> 8));
+    buf.push_back((char)(v & 0xff));
+}
+
+// 只处理一个问题，名字里没有压缩指针
+static bool stub_answer(const uint8_t* req, size_t len, std::string& rsp) {
+    if(len < 12) {
+        return false;
+    }
+    size_t pos = 12;
+    std::string name;
+    while(pos < len && req[pos]) {
+        if(!name.empty()) {
+            name.push_back('.');
+        }
+        name.append((const char*)req + pos + 1, req[pos]);
+        pos += 1 + req[pos];
+    }
+    if(pos + 5 > len) {
+        return false;
+    }
+    ++pos;
+    uint16_t qtype = req[pos] << 8 | req[pos + 1];
+    size_t qend = pos + 4;
+
+    std::vector<orange::IPAddress::ptr> addrs;
+    auto it = s_hosts.find(name);
+    if(it != s_hosts.end()) {
+        for(auto& i : it->second) {
+            if((qtype == 1 && i->getFamily() == AF_INET)
+                    || (qtype == 28 && i->getFamily() == AF_INET6)) {
+                addrs.push_back(i);
+            }
+        }
+    }
+
+    rsp.assign((const char*)req, 2);
+    put_u16(rsp, it == s_hosts.end() ? 0x8183 : 0x8180);
+    put_u16(rsp, 1);
+    put_u16(rsp, addrs.size());
+    put_u16(rsp, 0);
+    put_u16(rsp, 0);
+    rsp.append((const char*)req + 12, qend - 12);
+    for(auto& i : addrs) {
+        put_u16(rsp, 0xc00c);
+        put_u16(rsp, qtype);
+        put_u16(rsp, 1);
+        put_u16(rsp, 0);
+        put_u16(rsp, s_ttl);
+        if(i->getFamily() == AF_INET) {
+            put_u16(rsp, 4);
+            rsp.append((const char*)&((const sockaddr_in*)i->getAddr())->sin_addr, 4);
+        } else {
+            put_u16(rsp, 16);
+            rsp.append((const char*)&((const sockaddr_in6*)i->getAddr())->sin6_addr, 16);
+        }
+    }
+    return true;
+}
+
+void stub_server(orange::Socket::ptr sock) {
+    uint8_t buf[512];
+    while(true) {
+        sockaddr_storage from;
+        socklen_t from_len = sizeof(from);
+        int n = recvfrom(sock->getSocket(), buf, sizeof(buf), 0, (sockaddr*)&from, &from_len);
+        if(n < 0) {
+            break;
+        }
+        ++s_stub_queries;
+        std::string rsp;
+        if(stub_answer(buf, n, rsp)) {
+            sendto(sock->getSocket(), rsp.c_str(), rsp.size(), 0, (sockaddr*)&from, from_len);
+        }
+    }
+}
+
+orange::Socket::ptr bind_udp(const char* addr_str) {
+    orange::Address::ptr addr = orange::Address::LookupAny(addr_str);
+    orange::Socket::ptr sock = orange::Socket::CreateUDP(addr);
+    if(!sock->bind(addr)) {
+        return nullptr;
+    }
+    return sock;
+}
+
+std::string lookup(const std::string& host) {
+    orange::Address::ptr addr = orange::Address::LookupAny(host, AF_UNSPEC);
+    return addr ? addr->toString() : "";
+}
+
+void test_resolve() {
+    uint64_t queries = s_stub_queries;
+    CHECK(lookup("www.orange.test:80") == "10.0.0.1:80");
+    // A和AAAA各一个查询
+    CHECK(s_stub_queries == queries + 2);
+    CHECK(lookup("WWW.Orange.Test.:8080") == "10.0.0.1:8080");
+    CHECK(s_stub_queries == queries + 2);
+
+    std::vector<orange::Address::ptr> addrs;
+    CHECK(orange::Address::Lookup(addrs, "dual.orange.test", AF_UNSPEC));
+    CHECK(addrs.size() == 2);
+    addrs.clear();
+    CHECK(orange::Address::Lookup(addrs, "dual.orange.test", AF_INET6));
+    CHECK(addrs.size() == 1 && addrs[0]->getFamily() == AF_INET6);
+
+    queries = s_stub_queries;
+    CHECK(lookup("missing.orange.test:80") == "");
+    CHECK(lookup("missing.orange.test:80") == "");
+    CHECK(s_stub_queries == queries + 2);
+
+    // TTL和negative_ttl都是1秒
+    usleep(1100 * 1000);
+    queries = s_stub_queries;
+    CHECK(lookup("www.orange.test:80") == "10.0.0.1:80");
+    CHECK(lookup("missing.orange.test:80") == "");
+    CHECK(s_stub_queries == queries + 4);
+
+    orange::DnsResolver::Stat stat = orange::DnsMgr::GetInstance()->getStat();
+    ORANGE_LOG_INFO(g_logger) << "resolve hits=" << stat.hits
+        << " negative_hits=" << stat.negativeHits
+        << " misses=" << stat.misses
+        << " queries=" << stat.queries
+        << " failures=" << stat.failures
+        << " stub_queries=" << s_stub_queries;
+}
+
+// 服务器不回包时只挂起解析的协程，同线程的其他协程照常运行
+void test_silent_server(orange::IOManager* iom) {
+    orange::Config::Lookup<std::vector<std::string> >("dns.servers")->setValue({s_silent_addr});
+    orange::Config::Lookup<uint32_t>("dns.timeout_ms")->setValue(200);
+    orange::Config::Lookup<uint32_t>("dns.attempts")->setValue(1);
+    orange::DnsMgr::GetInstance()->clearCache();
+
+    std::atomic<bool> running = {true};
+    std::atomic<int> ticks = {0};
+    iom->schedule([&running, &ticks]() {
+        while(running) {
+            usleep(10 * 1000);
+            ++ticks;
+        }
+    });
+    uint64_t begin = orange::GetCurrentMS();
+    CHECK(lookup("www.orange.test:80") == "");
+    uint64_t used = orange::GetCurrentMS() - begin;
+    running = false;
+    ORANGE_LOG_INFO(g_logger) << "silent server: lookup failed after " << used
+        << "ms, other fiber ticks=" << ticks;
+    CHECK(ticks > 10);
+
+    orange::Config::Lookup<std::vector<std::string> >("dns.servers")->setValue({s_stub_addr});
+    orange::Config::Lookup<uint32_t>("dns.attempts")->setValue(2);
+}
+
+void bench(const char* name, const std::string& host, bool clear, int count) {
+    uint64_t begin = orange::GetCurrentUS();
+    for(int i = 0; i < count; ++i) {
+        if(clear) {
+            orange::DnsMgr::GetInstance()->clearCache();
+        }
+        if(lookup(host).empty()) {
+            ORANGE_LOG_ERROR(g_logger) << name << " lookup " << host << " fail";
+            break;
+        }
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    ORANGE_LOG_INFO(g_logger) << name << " lookups=" << count
+        << " us/lookup=" << used / count;
+}
+
+void run(orange::IOManager* iom) {
+    orange::Socket::ptr stub = bind_udp(s_stub_addr);
+    orange::Socket::ptr silent = bind_udp(s_silent_addr);
+    if(!stub || !silent) {
+        ORANGE_LOG_ERROR(g_logger) << "bind stub server fail";
+        ++s_failed;
+        return;
+    }
+    iom->schedule(std::bind(&stub_server, stub));
+
+    test_resolve();
+    test_silent_server(iom);
+
+    bench("cached     ", "www.orange.test:80", false, 10000);
+    bench("stub query ", "www.orange.test:80", true, 1000);
+    // 系统的hosts文件里一般有localhost
+    orange::Config::Lookup<bool>("dns.enable")->setValue(false);
+    bench("getaddrinfo", "localhost:80", false, 1000);
+
+    stub->close();
+    silent->close();
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::FATAL);
+    {
+        std::ofstream ofs(s_hosts_path);
+        ofs << "# stub dns records\n"
+            << "10.0.0.1 www.orange.test www\n"
+            << "10.0.0.2 dual.orange.test\n"
+            << "fd00::2  dual.orange.test # ipv6\n";
+    }
+    orange::DnsResolver::LoadHosts(s_hosts_path, s_hosts);
+    unlink(s_hosts_path);
+
+    orange::Config::Lookup<bool>("dns.enable")->setValue(true);
+    orange::Config::Lookup<std::string>("dns.hosts_file")->setValue("");
+    orange::Config::Lookup<std::vector<std::string> >("dns.servers")->setValue({s_stub_addr});
+    orange::Config::Lookup<uint32_t>("dns.negative_ttl")->setValue(s_ttl);
+
+    {
+        orange::IOManager iom(1, false, "dns");
+        iom.schedule(std::bind(&run, &iom));
+    }
+    ORANGE_LOG_INFO(g_logger) << (s_failed ? "FAILED" : "ALL OK") << " failed=" << s_failed;
+    return s_failed ? 1 : 0;
+}
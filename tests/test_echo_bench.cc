@@ -0,0 +1,137 @@
+#include "src/orange.h"
+#include "src/socket.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+
+/*
+* 分别以epoll和io_uring后端启动examples/echo_server，
+* 多个连接一问一答压测，统计吞吐和服务端每个请求消耗的CPU
+* usage: test_echo_bench [echo_server路径] [连接数] [秒数]
+*/
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static std::atomic<uint64_t> s_requests = {0};
+static std::atomic<bool> s_stop = {false};
+static std::atomic<int> s_running = {0};
+
+// 进程的用户态、内核态CPU时间，单位ms
+static bool read_cpu(pid_t pid, uint64_t& user_ms, uint64_t& sys_ms) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE* fp = fopen(path, "r");
+    if(!fp) {
+        return false;
+    }
+    unsigned long utime = 0, stime = 0;
+    int rt = fscanf(fp, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu"
+            , &utime, &stime);
+    fclose(fp);
+    long hz = sysconf(_SC_CLK_TCK);
+    user_ms = utime * 1000 / hz;
+    sys_ms = stime * 1000 / hz;
+    return rt == 2;
+}
+
+void client(orange::Address::ptr addr) {
+    orange::Socket::ptr sock = orange::Socket::CreateTCP(addr);
+    if(!sock->connect(addr)) {
+        --s_running;
+        return;
+    }
+    char buf[64] = "ping";
+    while(!s_stop) {
+        if(sock->send(buf, sizeof(buf)) != sizeof(buf)) {
+            break;
+        }
+        size_t got = 0;
+        while(got < sizeof(buf)) {
+            int rt = sock->recv(buf + got, sizeof(buf) - got);
+            if(rt <= 0) {
+                --s_running;
+                return;
+            }
+            got += rt;
+        }
+        ++s_requests;
+    }
+    sock->close();
+    --s_running;
+}
+
+bool wait_server(orange::Address::ptr addr) {
+    for(int i = 0; i < 100; ++i) {
+        orange::Socket::ptr sock = orange::Socket::CreateTCP(addr);
+        if(sock->connect(addr)) {
+            return true;
+        }
+        usleep(100 * 1000);
+    }
+    return false;
+}
+
+void bench(const char* server, const char* backend, int conns, int seconds) {
+    pid_t pid = fork();
+    if(pid == 0) {
+        execl(server, server, "-e", backend, (char*)nullptr);
+        _exit(1);
+    }
+
+    orange::Address::ptr addr = orange::Address::LookupAny("127.0.0.1:8020");
+    orange::IOManager iom(1, false, "client");
+    std::atomic<int> ready = {-1};
+    iom.schedule([addr, &ready]() {
+        ready = wait_server(addr) ? 1 : 0;
+    });
+    while(ready == -1 && waitpid(pid, nullptr, WNOHANG) == 0) {
+        usleep(100 * 1000);
+    }
+    if(ready != 1) {
+        ORANGE_LOG_ERROR(g_logger) << "echo_server " << backend << " not ready";
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        return;
+    }
+
+    s_requests = 0;
+    s_stop = false;
+    s_running = conns;
+    uint64_t user0, sys0, user1, sys1;
+    read_cpu(pid, user0, sys0);
+    uint64_t begin = orange::GetCurrentMS();
+    for(int i = 0; i < conns; ++i) {
+        iom.schedule(std::bind(&client, addr));
+    }
+    sleep(seconds);
+    s_stop = true;
+    while(s_running > 0) {
+        usleep(10 * 1000);
+    }
+    uint64_t used = orange::GetCurrentMS() - begin;
+    read_cpu(pid, user1, sys1);
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+
+    uint64_t reqs = s_requests;
+    ORANGE_LOG_INFO(g_logger) << "backend=" << backend
+        << " conns=" << conns
+        << " requests=" << reqs
+        << " req/s=" << reqs * 1000 / (used ? used : 1)
+        << " server_user_us/req=" << (reqs ? (user1 - user0) * 1000.0 / reqs : 0)
+        << " server_sys_us/req=" << (reqs ? (sys1 - sys0) * 1000.0 / reqs : 0);
+}
+
+int main(int argc, char** argv) {
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::FATAL);
+    const char* server = argc > 1 ? argv[1] : "bin/echo_server";
+    int conns = argc > 2 ? atoi(argv[2]) : 64;
+    int seconds = argc > 3 ? atoi(argv[3]) : 5;
+    bench(server, "epoll", conns, seconds);
+    bench(server, "io_uring", conns, seconds);
+    return 0;
+}
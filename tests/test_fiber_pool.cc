@@ -0,0 +1,54 @@
+#include "src/orange.h"
+
+#include <unistd.h>
+
+#include <atomic>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static std::atomic<int> s_done = {0};
+
+// 模拟一次请求：挂起等待后再继续，协程会被交给定时器，不能被当前线程直接复用
+void request() {
+    usleep(100);
+    ++s_done;
+}
+
+void bench(size_t threads, int count, uint32_t pool_high) {
+    orange::Config::Lookup<uint32_t>("scheduler.fiber_pool_high")->setValue(pool_high);
+    s_done = 0;
+    orange::IOManager iom(threads, false, "pool");
+    uint64_t fibers = orange::Fiber::TotalFibers();
+    uint64_t begin = orange::GetCurrentUS();
+    for(int i = 0; i < count; ++i) {
+        iom.schedule(&request);
+        // 控制在途请求数
+        while(i - s_done > 1000) {
+            ::usleep(100);
+        }
+    }
+    while(s_done < count) {
+        ::usleep(1000);
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    orange::Scheduler::FiberPoolStat stat = iom.getFiberPoolStat();
+    ORANGE_LOG_INFO(g_logger) << "threads=" << threads
+        << " pool_high=" << pool_high
+        << " requests=" << count
+        << " used=" << used / 1000 << "ms"
+        << " pool_hits=" << stat.hits
+        << " pool_misses=" << stat.misses
+        << " pool_size=" << stat.size
+        << " live_fibers=" << orange::Fiber::TotalFibers() - fibers;
+}
+
+int main(int argc, char** argv) {
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    std::vector<size_t> ts = {1, 4};
+    if(argc > 1) ts = {(size_t)atoi(argv[1])};
+    for(size_t threads : ts) {
+        bench(threads, 100000, 0);
+        bench(threads, 100000, 1024);
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "src/orange.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static size_t get_rss() {
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if(!fp) {
+        return 0;
+    }
+    size_t size = 0, resident = 0;
+    if(fscanf(fp, "%zu %zu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(fp);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static std::atomic<uint64_t> s_sum = {0};
+
+// 模拟空闲连接：用掉一点栈后挂起，恢复后检查栈上的数据
+void idle_conn() {
+    char buf[1024];
+    memset(buf, (int)(orange::Fiber::GetFiberId() & 0x7f), sizeof(buf));
+    orange::Fiber::ptr cur = orange::Fiber::GetThis();
+    cur->setState(orange::Fiber::HOLD);
+    orange::Fiber* fiber = cur.get();
+    cur.reset();
+    fiber->back();
+    ORANGE_ASSERT(buf[0] == buf[sizeof(buf) - 1]
+            && buf[0] == (char)(orange::Fiber::GetFiberId() & 0x7f));
+    s_sum += buf[0];
+}
+
+void bench_park(bool shared, size_t count) {
+    if(!shared) {
+        // 独立栈每个协程占两个映射区(栈和保护页)
+        count = std::min(count, (size_t)30000);
+    }
+    size_t rss = get_rss();
+    uint64_t begin = orange::GetCurrentUS();
+    std::vector<orange::Fiber::ptr> fibers;
+    fibers.reserve(count);
+    for(size_t i = 0; i < count; ++i) {
+        fibers.emplace_back(new orange::Fiber(&idle_conn, 0, true, shared));
+        fibers.back()->call();
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    size_t peak = get_rss() - rss;
+
+    begin = orange::GetCurrentUS();
+    for(auto& i : fibers) {
+        i->call();
+    }
+    uint64_t resume_used = orange::GetCurrentUS() - begin;
+    fibers.clear();
+    ORANGE_LOG_INFO(g_logger) << (shared ? "shared" : "separate")
+        << " parked=" << count
+        << " rss=" << peak / 1024 / 1024 << "MB"
+        << " rss/fiber=" << peak / count << "B"
+        << " park_ns=" << used * 1000 / count
+        << " resume_ns=" << resume_used * 1000 / count;
+}
+
+static std::atomic<int> s_done = {0};
+
+void request() {
+    char buf[256];
+    memset(buf, 1, sizeof(buf));
+    usleep(100);
+    ORANGE_ASSERT(buf[0] == 1 && buf[sizeof(buf) - 1] == 1);
+    ++s_done;
+}
+
+// 调度器里使用共享栈：挂起的协程只会在原线程恢复
+void test_scheduler(size_t threads, int count) {
+    s_done = 0;
+    orange::IOManager iom(threads, false, "shared");
+    iom.setSharedStack(true);
+    for(int i = 0; i < count; ++i) {
+        iom.schedule(&request);
+    }
+    while(s_done < count) {
+        ::usleep(1000);
+    }
+    ORANGE_LOG_INFO(g_logger) << "scheduler threads=" << threads
+        << " shared stack requests=" << s_done;
+}
+
+int main(int argc, char** argv) {
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    size_t count = argc > 1 ? atoi(argv[1]) : 100000;
+    orange::Fiber::GetThis();
+    bench_park(false, count);
+    bench_park(true, count);
+    test_scheduler(4, 10000);
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "src/orange.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <iostream>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static void set_allocator(const std::string& allocator) {
+    orange::Config::Lookup<std::string>("fiber.stack_allocator")->setValue(allocator);
+}
+
+static size_t get_rss() {
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if(!fp) {
+        return 0;
+    }
+    size_t size = 0, resident = 0;
+    if(fscanf(fp, "%zu %zu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(fp);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static size_t get_max_map_count() {
+    FILE* fp = fopen("/proc/sys/vm/max_map_count", "r");
+    if(!fp) {
+        return 65530;
+    }
+    size_t count = 65530;
+    if(fscanf(fp, "%zu", &count) != 1) {
+        count = 65530;
+    }
+    fclose(fp);
+    return count;
+}
+
+void empty_fiber() {
+}
+
+// 用掉一部分栈后切回主协程
+void touch_fiber() {
+    volatile char buf[8192];
+    memset((char*)buf, 1, sizeof(buf));
+    orange::Fiber::ptr cur = orange::Fiber::GetThis();
+    cur->setState(orange::Fiber::HOLD);
+    orange::Fiber* fiber = cur.get();
+    cur.reset();
+    fiber->back();
+}
+
+void bench_create(const std::string& allocator, size_t stack_size, int count) {
+    set_allocator(allocator);
+    uint64_t begin = orange::GetCurrentUS();
+    for(int i = 0; i < count; ++i) {
+        orange::Fiber::ptr fiber(new orange::Fiber(&empty_fiber, stack_size, true));
+        fiber->call();
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    ORANGE_LOG_INFO(g_logger) << "create/destroy allocator=" << allocator
+        << " stack_size=" << stack_size
+        << " fibers/sec=" << (uint64_t)(count * 1000000.0 / used)
+        << " ns/fiber=" << used * 1000 / count;
+}
+
+void bench_rss(const std::string& allocator, size_t stack_size, size_t count) {
+    set_allocator(allocator);
+    // 每个带保护页的栈占两个映射区
+    size_t max_count = (get_max_map_count() - 1000) / 2;
+    if(allocator == "mmap" && count > max_count) {
+        ORANGE_LOG_INFO(g_logger) << "vm.max_map_count limits mmap stacks to "
+            << max_count << ", requested " << count;
+        count = max_count;
+    }
+
+    size_t rss = get_rss();
+    uint64_t begin = orange::GetCurrentUS();
+    std::vector<orange::Fiber::ptr> fibers;
+    fibers.reserve(count);
+    for(size_t i = 0; i < count; ++i) {
+        fibers.emplace_back(new orange::Fiber(&touch_fiber, stack_size, true));
+        fibers.back()->call();
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    size_t peak = get_rss();
+    for(auto& i : fibers) {
+        i->call();
+    }
+    fibers.clear();
+    ORANGE_LOG_INFO(g_logger) << "rss allocator=" << allocator
+        << " fibers=" << count
+        << " stack_size=" << stack_size
+        << " rss=" << (peak - rss) / 1024 / 1024 << "MB"
+        << " rss/fiber=" << (peak - rss) / count / 1024 << "KB"
+        << " create_used=" << used / 1000 << "ms"
+        << " rss_after_free=" << (get_rss() - rss) / 1024 / 1024 << "MB";
+}
+
+// 每个分配器在新的子进程里测，free之后留下的堆不影响下一个的RSS
+void bench_rss_fork(const std::string& allocator, size_t stack_size, size_t count) {
+    std::cout.flush();
+    pid_t pid = fork();
+    if(pid == 0) {
+        bench_rss(allocator, stack_size, count);
+        std::cout.flush();
+        _exit(0);
+    } else if(pid < 0) {
+        ORANGE_LOG_ERROR(g_logger) << "fork errno=" << errno;
+        return;
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? atoi(argv[1]) : 100000;
+    size_t stack_size = argc > 2 ? atoi(argv[2]) : 32 * 1024;
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    orange::Fiber::GetThis();
+
+    for(auto& allocator : {"malloc", "mmap"}) {
+        bench_create(allocator, 1024 * 1024, 100000);
+        bench_create(allocator, stack_size, 100000);
+    }
+    for(auto& allocator : {"malloc", "mmap"}) {
+        bench_rss_fork(allocator, stack_size, count);
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "src/orange.h"
+
+#include <ucontext.h>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const int s_count = 1000000;
+
+void ping() {
+    while(true) {
+        orange::Fiber::ptr cur = orange::Fiber::GetThis();
+        cur->setState(orange::Fiber::HOLD);
+        orange::Fiber* fiber = cur.get();
+        cur.reset();
+        fiber->back();
+    }
+}
+
+// Fiber::call/back来回切换，每轮两次切换
+void bench_fiber() {
+    orange::Fiber::GetThis();
+    orange::Fiber::ptr fiber(new orange::Fiber(&ping, 0, true));
+    uint64_t begin = orange::GetCurrentUS();
+    for(int i = 0; i < s_count; ++i) {
+        fiber->call();
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    ORANGE_LOG_INFO(g_logger) << "fiber "
+#ifdef ORANGE_FIBER_ASM
+        << "asm"
+#else
+        << "ucontext"
+#endif
+        << " switches=" << s_count * 2
+        << " ns/switch=" << used * 1000.0 / (s_count * 2);
+    // 协程没有结束，只能直接丢弃
+    new orange::Fiber::ptr(fiber);
+}
+
+static ucontext_t s_main_ctx;
+static ucontext_t s_ping_ctx;
+
+void uc_ping() {
+    while(true) {
+        swapcontext(&s_ping_ctx, &s_main_ctx);
+    }
+}
+
+// 直接使用swapcontext作为对照
+void bench_ucontext() {
+    static char stack[64 * 1024];
+    getcontext(&s_ping_ctx);
+    s_ping_ctx.uc_link = nullptr;
+    s_ping_ctx.uc_stack.ss_sp = stack;
+    s_ping_ctx.uc_stack.ss_size = sizeof(stack);
+    makecontext(&s_ping_ctx, uc_ping, 0);
+    uint64_t begin = orange::GetCurrentUS();
+    for(int i = 0; i < s_count; ++i) {
+        swapcontext(&s_main_ctx, &s_ping_ctx);
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    ORANGE_LOG_INFO(g_logger) << "raw swapcontext switches=" << s_count * 2
+        << " ns/switch=" << used * 1000.0 / (s_count * 2);
+}
+
+int main(int argc, char** argv) {
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    bench_fiber();
+    bench_ucontext();
+    return 0;
+}
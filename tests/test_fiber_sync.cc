@@ -0,0 +1,303 @@
+#include "src/orange.h"
+#include "src/channel.h"
+#include "src/fiber_sync.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+/*
+* 协程同步原语的正确性检查，以及和pthread版本(线程阻塞)的对比：
+* 锁竞争、信号量和条件变量的乒乓、通道的生产者消费者
+*/
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const int s_lock_count = 20000;
+static const int s_pingpong_count = 50000;
+static const int s_channel_count = 200000;
+static int s_failed = 0;
+
+#define CHECK(cond) \
+    if(!(cond)) { \
+        ++s_failed; \
+        ORANGE_LOG_ERROR(g_logger) << "check fail: " #cond; \
+    }
+
+void report(const char* name, int count, uint64_t used_us) {
+    ORANGE_LOG_INFO(g_logger) << name << " ops=" << count
+        << " ns/op=" << used_us * 1000.0 / count;
+}
+
+// fibers个协程在threads个线程上竞争同一把锁
+template<class MutexType>
+void bench_mutex(const char* name, int threads, int fibers) {
+    MutexType mutex;
+    int64_t counter = 0;
+    orange::FiberWaitGroup wg;
+    wg.add(fibers);
+    uint64_t begin = orange::GetCurrentUS();
+    {
+        orange::IOManager iom(threads, false, "mutex");
+        for(int i = 0; i < fibers; ++i) {
+            iom.schedule([&mutex, &counter, &wg]() {
+                for(int j = 0; j < s_lock_count; ++j) {
+                    typename MutexType::Lock lock(mutex);
+                    ++counter;
+                }
+                wg.done();
+            });
+        }
+        // 普通线程上等待，走信号量
+        wg.wait();
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    CHECK(counter == (int64_t)s_lock_count * fibers);
+    report(name, s_lock_count * fibers, used);
+}
+
+// 持有锁时挂起(hook的usleep)，同线程的其他协程照常运行
+void test_mutex_park() {
+    orange::FiberMutex mutex;
+    orange::FiberWaitGroup wg;
+    std::atomic<bool> running = {true};
+    std::atomic<int> ticks = {0};
+    int holders = 0;
+    int max_holders = 0;
+    wg.add(4);
+    uint64_t begin = orange::GetCurrentMS();
+    {
+        orange::IOManager iom(1, false, "park");
+        iom.schedule([&running, &ticks]() {
+            while(running) {
+                usleep(1000);
+                ++ticks;
+            }
+        });
+        for(int i = 0; i < 4; ++i) {
+            iom.schedule([&]() {
+                orange::FiberMutex::Lock lock(mutex);
+                max_holders = std::max(max_holders, ++holders);
+                usleep(20 * 1000);
+                --holders;
+                lock.unlock();
+                wg.done();
+            });
+        }
+        wg.wait();
+        running = false;
+    }
+    uint64_t used = orange::GetCurrentMS() - begin;
+    ORANGE_LOG_INFO(g_logger) << "mutex held across sleep: 4 holders in " << used
+        << "ms, other fiber ticks=" << ticks;
+    CHECK(max_holders == 1);
+    CHECK(used >= 80);
+    CHECK(ticks > 20);
+}
+
+void test_wait_group() {
+    orange::FiberWaitGroup wg;
+    std::atomic<int> done = {0};
+    {
+        orange::IOManager iom(2, false, "wg");
+        iom.schedule([&iom, &wg, &done]() {
+            orange::FiberWaitGroup inner;
+            inner.add(100);
+            for(int i = 0; i < 100; ++i) {
+                iom.schedule([&inner, &done]() {
+                    ++done;
+                    inner.done();
+                });
+            }
+            // 协程里等待，挂起协程
+            inner.wait();
+            CHECK(done == 100);
+            wg.add(1);
+            wg.done();
+        });
+    }
+    wg.wait();
+    CHECK(done == 100);
+}
+
+// 两个线程用pthread信号量乒乓
+void bench_sem_thread() {
+    orange::Semaphore ping;
+    orange::Semaphore pong;
+    uint64_t begin = orange::GetCurrentUS();
+    orange::Thread thr([&ping, &pong]() {
+        for(int i = 0; i < s_pingpong_count; ++i) {
+            ping.wait();
+            pong.notify();
+        }
+    }, "pong");
+    for(int i = 0; i < s_pingpong_count; ++i) {
+        ping.notify();
+        pong.wait();
+    }
+    thr.join();
+    report("semaphore pthread  ", s_pingpong_count, orange::GetCurrentUS() - begin);
+}
+
+// 同一个线程上的两个协程用协程信号量乒乓
+void bench_sem_fiber() {
+    orange::FiberSemaphore ping;
+    orange::FiberSemaphore pong;
+    orange::FiberWaitGroup wg;
+    wg.add(2);
+    uint64_t begin = orange::GetCurrentUS();
+    {
+        orange::IOManager iom(1, false, "sem");
+        iom.schedule([&ping, &pong, &wg]() {
+            for(int i = 0; i < s_pingpong_count; ++i) {
+                ping.wait();
+                pong.notify();
+            }
+            wg.done();
+        });
+        iom.schedule([&ping, &pong, &wg]() {
+            for(int i = 0; i < s_pingpong_count; ++i) {
+                ping.notify();
+                pong.wait();
+            }
+            wg.done();
+        });
+        wg.wait();
+    }
+    report("semaphore fiber    ", s_pingpong_count, orange::GetCurrentUS() - begin);
+}
+
+void bench_cond_thread() {
+    std::mutex mutex;
+    std::condition_variable cond;
+    int turn = 0;
+    uint64_t begin = orange::GetCurrentUS();
+    orange::Thread thr([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(int i = 0; i < s_pingpong_count; ++i) {
+            cond.wait(lock, [&turn]() { return turn == 1; });
+            turn = 0;
+            cond.notify_one();
+        }
+    }, "pong");
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(int i = 0; i < s_pingpong_count; ++i) {
+            turn = 1;
+            cond.notify_one();
+            cond.wait(lock, [&turn]() { return turn == 0; });
+        }
+    }
+    thr.join();
+    report("condvar pthread    ", s_pingpong_count, orange::GetCurrentUS() - begin);
+}
+
+void bench_cond_fiber() {
+    orange::FiberMutex mutex;
+    orange::FiberCondVar cond;
+    orange::FiberWaitGroup wg;
+    int turn = 0;
+    wg.add(2);
+    uint64_t begin = orange::GetCurrentUS();
+    {
+        orange::IOManager iom(1, false, "cond");
+        iom.schedule([&]() {
+            orange::FiberMutex::Lock lock(mutex);
+            for(int i = 0; i < s_pingpong_count; ++i) {
+                cond.wait(mutex, [&turn]() { return turn == 1; });
+                turn = 0;
+                cond.notifyOne();
+            }
+            lock.unlock();
+            wg.done();
+        });
+        iom.schedule([&]() {
+            orange::FiberMutex::Lock lock(mutex);
+            for(int i = 0; i < s_pingpong_count; ++i) {
+                turn = 1;
+                cond.notifyOne();
+                cond.wait(mutex, [&turn]() { return turn == 0; });
+            }
+            lock.unlock();
+            wg.done();
+        });
+        wg.wait();
+    }
+    report("condvar fiber      ", s_pingpong_count, orange::GetCurrentUS() - begin);
+}
+
+// 同一个通道，两端是普通线程(信号量阻塞)
+void bench_channel_thread() {
+    orange::Channel<int> chan(64);
+    int64_t sum = 0;
+    uint64_t begin = orange::GetCurrentUS();
+    orange::Thread thr([&chan]() {
+        for(int i = 0; i < s_channel_count; ++i) {
+            chan.push(i);
+        }
+    }, "producer");
+    for(int i = 0; i < s_channel_count; ++i) {
+        int v = 0;
+        chan.pop(v);
+        sum += v;
+    }
+    thr.join();
+    CHECK(sum == (int64_t)s_channel_count * (s_channel_count - 1) / 2);
+    report("channel(64) thread ", s_channel_count, orange::GetCurrentUS() - begin);
+}
+
+// 两端是协程
+void bench_channel_fiber(int threads) {
+    orange::Channel<int> chan(64);
+    orange::FiberWaitGroup wg;
+    int64_t sum = 0;
+    wg.add(2);
+    uint64_t begin = orange::GetCurrentUS();
+    {
+        orange::IOManager iom(threads, false, "chan");
+        iom.schedule([&chan, &wg]() {
+            for(int i = 0; i < s_channel_count; ++i) {
+                chan.push(i);
+            }
+            wg.done();
+        });
+        iom.schedule([&chan, &wg, &sum]() {
+            for(int i = 0; i < s_channel_count; ++i) {
+                int v = 0;
+                chan.pop(v);
+                sum += v;
+            }
+            wg.done();
+        });
+        wg.wait();
+    }
+    CHECK(sum == (int64_t)s_channel_count * (s_channel_count - 1) / 2);
+    report(threads == 1 ? "channel(64) fiber 1t" : "channel(64) fiber 2t"
+            , s_channel_count, orange::GetCurrentUS() - begin);
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::FATAL);
+
+    test_mutex_park();
+    test_wait_group();
+
+    bench_mutex<orange::Mutex>("mutex pthread 2t x 8f", 2, 8);
+    bench_mutex<orange::FiberMutex>("mutex fiber   2t x 8f", 2, 8);
+    bench_mutex<orange::Mutex>("mutex pthread 4t x 8f", 4, 8);
+    bench_mutex<orange::FiberMutex>("mutex fiber   4t x 8f", 4, 8);
+
+    bench_sem_thread();
+    bench_sem_fiber();
+    bench_cond_thread();
+    bench_cond_fiber();
+    bench_channel_thread();
+    bench_channel_fiber(1);
+    bench_channel_fiber(2);
+
+    ORANGE_LOG_INFO(g_logger) << (s_failed ? "FAILED" : "ALL OK") << " failed=" << s_failed;
+    return s_failed ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+#include "src/orange.h"
+#include "src/fd_manager.h"
+#include "src/hook.h"
+
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <new>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+// 统计堆分配次数
+static std::atomic<uint64_t> s_allocs = {0};
+
+void* operator new(size_t size) {
+    ++s_allocs;
+    void* p = malloc(size);
+    if(!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static const int s_ops = 200000;
+
+// 数据总是已经到达，recv不会挂起
+void bench(const char* name, bool hook, bool timeout) {
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+        ORANGE_LOG_ERROR(g_logger) << "socketpair errno=" << errno;
+        return;
+    }
+    // socketpair没有hook，手动登记为socket
+    orange::FdMrg::GetInstance()->get(fds[0], true);
+    orange::FdMrg::GetInstance()->get(fds[1], true);
+    if(timeout) {
+        timeval tv = {1, 0};
+        setsockopt(fds[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+
+    orange::set_hook_enable(hook);
+    char c = 'r';
+    uint64_t allocs = s_allocs;
+    uint64_t begin = orange::GetCurrentUS();
+    for(int i = 0; i < s_ops; ++i) {
+        if(send(fds[0], &c, 1, 0) != 1 || recv(fds[1], &c, 1, 0) != 1) {
+            ORANGE_LOG_ERROR(g_logger) << "io errno=" << errno;
+            break;
+        }
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    allocs = s_allocs - allocs;
+    orange::set_hook_enable(true);
+    close(fds[0]);
+    close(fds[1]);
+
+    ORANGE_LOG_INFO(g_logger) << name
+        << " ops=" << s_ops
+        << " send+recv=" << used * 1000 / s_ops << "ns"
+        << " allocs/op=" << (double)allocs / s_ops;
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    orange::IOManager iom(1, false, "recv");
+    iom.schedule([]() {
+        bench("raw          ", false, false);
+        bench("hook         ", true, false);
+        bench("hook+timeout ", true, true);
+    });
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include "src/orange.h"
+#include "src/fd_manager.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const int s_pairs = 2000;
+static const int s_bursts = 20;
+static const int s_timer_ms = 1;
+static std::atomic<uint64_t> s_reads = {0};
+static std::atomic<int> s_exited = {0};
+
+// 每次读到数据后做一点计算，模拟处理请求
+void reader(int fd) {
+    char buf[64];
+    while(true) {
+        int rt = read(fd, buf, sizeof(buf));
+        if(rt <= 0) {
+            break;
+        }
+        volatile uint64_t sum = 0;
+        for(int i = 0; i < 200; ++i) {
+            sum += i;
+        }
+        ++s_reads;
+    }
+    close(fd);
+    ++s_exited;
+}
+
+void bench(const char* name, uint32_t batch_min, uint32_t batch_max, uint32_t budget_us) {
+    orange::Config::Lookup<uint32_t>("iomanager.epoll_batch_min")->setValue(batch_min);
+    orange::Config::Lookup<uint32_t>("iomanager.epoll_batch_max")->setValue(batch_max);
+    orange::Config::Lookup<uint32_t>("iomanager.event_budget_us")->setValue(budget_us);
+    s_reads = 0;
+    s_exited = 0;
+
+    std::vector<int> writers;
+    orange::Histogram lateness;
+    {
+        orange::IOManager iom(1, false, "batch");
+        for(int i = 0; i < s_pairs; ++i) {
+            int fds[2];
+            if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+                ORANGE_LOG_ERROR(g_logger) << "socketpair errno=" << errno;
+                return;
+            }
+            // socketpair没有hook，手动登记为socket
+            orange::FdMrg::GetInstance()->get(fds[1], true);
+            int fd = fds[1];
+            iom.schedule([fd]() { reader(fd); });
+            writers.push_back(fds[0]);
+        }
+
+        // 定时器实际触发时间比预期晚多少
+        uint64_t expect = orange::GetCurrentUS() + s_timer_ms * 1000;
+        orange::Timer::ptr timer = iom.addTimer(s_timer_ms, [&lateness, &expect]() {
+            uint64_t now = orange::GetCurrentUS();
+            lateness.add(now > expect ? now - expect : 0);
+            expect = now + s_timer_ms * 1000;
+        }, true);
+
+        // 普通线程突发写入，所有fd同时变为可读
+        uint64_t begin = orange::GetCurrentUS();
+        uint64_t waits = iom.getEpollWaitCount();
+        std::thread th([&writers]() {
+            char c = 'b';
+            for(int i = 0; i < s_bursts; ++i) {
+                for(int fd : writers) {
+                    if(write(fd, &c, 1) != 1) {
+                        ORANGE_LOG_ERROR(g_logger) << "write errno=" << errno;
+                    }
+                }
+                usleep(100 * 1000);
+            }
+        });
+        th.join();
+        while(s_reads < (uint64_t)s_pairs * s_bursts
+                && orange::GetCurrentUS() - begin < 30 * 1000 * 1000) {
+            usleep(1000);
+        }
+        uint64_t used = orange::GetCurrentUS() - begin;
+        waits = iom.getEpollWaitCount() - waits;
+        timer->cancel();
+
+        ORANGE_LOG_INFO(g_logger) << name
+            << " batch=[" << batch_min << "," << batch_max << "]"
+            << " budget_us=" << budget_us
+            << " used=" << used / 1000 << "ms"
+            << " reads=" << s_reads
+            << " epoll_waits=" << waits
+            << " timer_late_p50<" << lateness.percentile(0.5) << "us"
+            << " p99<" << lateness.percentile(0.99) << "us"
+            << " max<" << lateness.percentile(1) << "us";
+        ORANGE_LOG_INFO(g_logger) << name << " events/wait: "
+            << iom.getEventsPerWait().toString();
+        ORANGE_LOG_INFO(g_logger) << name << " us/loop: "
+            << iom.getLoopTime().toString();
+
+        for(int fd : writers) {
+            close(fd);
+        }
+        while(s_exited < s_pairs) {
+            usleep(1000);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    bench("fixed", 64, 64, 0);
+    bench("adaptive", 64, 4096, 0);
+    bench("adaptive+budget", 64, 4096, 1000);
+    return 0;
+}
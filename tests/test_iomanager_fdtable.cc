@@ -0,0 +1,70 @@
+#include "src/orange.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const int s_pipes = 64;
+static const int s_rounds = 2000;
+static std::atomic<int> s_done = {0};
+static std::atomic<uint64_t> s_ops = {0};
+
+// 反复注册、删除读事件，管道没有数据，事件不会触发
+void register_task() {
+    int fds[s_pipes][2];
+    for(int i = 0; i < s_pipes; ++i) {
+        ORANGE_ASSERT(pipe(fds[i]) == 0);
+        fcntl(fds[i][0], F_SETFL, O_NONBLOCK);
+    }
+    orange::IOManager* iom = orange::IOManager::GetThis();
+    uint64_t ops = 0;
+    for(int r = 0; r < s_rounds; ++r) {
+        for(int i = 0; i < s_pipes; ++i) {
+            iom->addEvent(fds[i][0], orange::IOManager::READ, []() {});
+            iom->delEvent(fds[i][0], orange::IOManager::READ);
+            ops += 2;
+        }
+    }
+    for(int i = 0; i < s_pipes; ++i) {
+        close(fds[i][0]);
+        close(fds[i][1]);
+    }
+    s_ops += ops;
+    ++s_done;
+}
+
+void bench(size_t threads) {
+    s_done = 0;
+    s_ops = 0;
+    orange::IOManager iom(threads, false, "fdtable");
+    uint64_t begin = orange::GetCurrentUS();
+    for(size_t i = 0; i < threads; ++i) {
+        iom.schedule(&register_task);
+    }
+    while(s_done < (int)threads) {
+        usleep(1000);
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    ORANGE_LOG_INFO(g_logger) << "threads=" << threads
+        << " ops=" << s_ops
+        << " used=" << used / 1000 << "ms"
+        << " ops/sec=" << (uint64_t)(s_ops * 1000000.0 / used);
+}
+
+int main(int argc, char** argv) {
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    std::vector<size_t> threads = {1, 4, 16};
+    if(argc > 1) {
+        threads.clear();
+        for(int i = 1; i < argc; ++i) {
+            threads.push_back(atoi(argv[i]));
+        }
+    }
+    for(auto n : threads) {
+        bench(n);
+    }
+    return 0;
+}
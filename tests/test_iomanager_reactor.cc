@@ -0,0 +1,98 @@
+#include "src/orange.h"
+#include "src/fd_manager.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const int s_pairs = 64;
+static const int s_requests = 2000;
+static std::atomic<int> s_done = {0};
+static std::atomic<uint64_t> s_migrations = {0};
+
+// 一问一答，记录每次IO返回后是否换了线程
+void client(int fd) {
+    char c = 'c';
+    int thread = orange::GetThreadId();
+    uint64_t migrations = 0;
+    for(int i = 0; i < s_requests; ++i) {
+        if(write(fd, &c, 1) != 1 || read(fd, &c, 1) != 1) {
+            ORANGE_LOG_ERROR(g_logger) << "client io error errno=" << errno;
+            break;
+        }
+        if(orange::GetThreadId() != thread) {
+            thread = orange::GetThreadId();
+            ++migrations;
+        }
+    }
+    s_migrations += migrations;
+    close(fd);
+    ++s_done;
+}
+
+void server(int fd) {
+    char c;
+    while(read(fd, &c, 1) == 1) {
+        if(write(fd, &c, 1) != 1) {
+            break;
+        }
+    }
+    close(fd);
+    ++s_done;
+}
+
+void bench(size_t threads, bool multi_reactor) {
+    orange::Config::Lookup<bool>("iomanager.multi_reactor")->setValue(multi_reactor);
+    s_done = 0;
+    s_migrations = 0;
+    orange::IOManager iom(threads, false, "reactor");
+
+    uint64_t wakeups = iom.getWakeupCount();
+    uint64_t begin = orange::GetCurrentUS();
+    for(int i = 0; i < s_pairs; ++i) {
+        int fds[2];
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+            ORANGE_LOG_ERROR(g_logger) << "socketpair errno=" << errno;
+            return;
+        }
+        // socketpair没有hook，手动登记为socket
+        orange::FdMrg::GetInstance()->get(fds[0], true);
+        orange::FdMrg::GetInstance()->get(fds[1], true);
+        int sfd = fds[1];
+        int cfd = fds[0];
+        iom.schedule([sfd]() { server(sfd); });
+        iom.schedule([cfd]() { client(cfd); });
+    }
+    while(s_done < s_pairs * 2) {
+        usleep(1000);
+    }
+
+    uint64_t used = orange::GetCurrentUS() - begin;
+    uint64_t total = (uint64_t)s_pairs * s_requests;
+    wakeups = iom.getWakeupCount() - wakeups;
+    ORANGE_LOG_INFO(g_logger) << "threads=" << threads
+        << " multi_reactor=" << multi_reactor
+        << " requests=" << total
+        << " req/s=" << (uint64_t)(total * 1000000.0 / used)
+        << " wakeups/req=" << (double)wakeups / total
+        << " migrations/req=" << (double)s_migrations / total;
+}
+
+int main(int argc, char** argv) {
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    std::vector<size_t> threads = {1, 4};
+    if(argc > 1) {
+        threads.clear();
+        for(int i = 1; i < argc; ++i) {
+            threads.push_back(atoi(argv[i]));
+        }
+    }
+    for(auto n : threads) {
+        bench(n, false);
+        bench(n, true);
+    }
+    return 0;
+}
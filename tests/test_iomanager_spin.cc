@@ -0,0 +1,161 @@
+#include "src/orange.h"
+#include "src/socket.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const int s_msg_size = 16;
+
+void echo(orange::Socket::ptr client) {
+    char buf[s_msg_size];
+    while(true) {
+        int rt = client->recv(buf, sizeof(buf));
+        if(rt <= 0 || client->send(buf, rt) != rt) {
+            break;
+        }
+    }
+    client->close();
+}
+
+// 在工作线程中创建监听socket，hook才会把它设为非阻塞
+void accept_loop(orange::Socket::ptr* out, std::atomic<int>* port) {
+    orange::Socket::ptr sock = orange::Socket::CreateTCPSocket();
+    sock->bind(orange::IPv4Address::Create("127.0.0.1", 0));
+    sock->listen();
+    *out = sock;
+    *port = std::dynamic_pointer_cast<orange::IPAddress>(
+            sock->getLocalAddress())->getPort();
+    while(orange::Socket::ptr client = sock->accept()) {
+        orange::IOManager::GetThis()->schedule(std::bind(echo, client));
+    }
+}
+
+// 普通线程阻塞读写，记录每次往返的时间
+void client(uint16_t port, int requests, int interval_us, std::vector<uint64_t>* rtts) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+        ORANGE_LOG_ERROR(g_logger) << "connect errno=" << errno;
+        close(fd);
+        return;
+    }
+    int val = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+
+    char buf[s_msg_size] = {0};
+    for(int i = 0; i < requests; ++i) {
+        uint64_t begin = orange::GetCurrentUS();
+        if(write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+            break;
+        }
+        int n = 0;
+        while(n < s_msg_size) {
+            int rt = read(fd, buf + n, sizeof(buf) - n);
+            if(rt <= 0) {
+                break;
+            }
+            n += rt;
+        }
+        rtts->push_back(orange::GetCurrentUS() - begin);
+        if(interval_us) {
+            usleep(interval_us);
+        }
+    }
+    close(fd);
+}
+
+// 工作线程已用的cpu时间(us)
+uint64_t worker_cpu_us(orange::IOManager& iom) {
+    std::atomic<int64_t> result = {-1};
+    iom.schedule([&result]() {
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        result = ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+    });
+    while(result < 0) {
+        usleep(100);
+    }
+    return result;
+}
+
+void bench(const char* load, int clients, int requests, int interval_us
+        , uint32_t spin_us, uint32_t busy_poll_us) {
+    orange::Config::Lookup<uint32_t>("iomanager.spin_us")->setValue(spin_us);
+    orange::Config::Lookup<uint32_t>("socket.busy_poll_us")->setValue(busy_poll_us);
+
+    orange::IOManager iom(1, false, "spin");
+    orange::Socket::ptr sock;
+    std::atomic<int> port = {0};
+    iom.schedule(std::bind(accept_loop, &sock, &port));
+    while(port == 0) {
+        usleep(100);
+    }
+
+    std::vector<std::vector<uint64_t>> rtts(clients);
+    std::vector<std::thread> threads;
+    uint64_t cpu = worker_cpu_us(iom);
+    uint64_t begin = orange::GetCurrentUS();
+    for(int i = 0; i < clients; ++i) {
+        threads.emplace_back(client, (uint16_t)port, requests, interval_us, &rtts[i]);
+    }
+    for(auto& th : threads) {
+        th.join();
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    cpu = worker_cpu_us(iom) - cpu;
+
+    std::vector<uint64_t> all;
+    for(auto& v : rtts) {
+        all.insert(all.end(), v.begin(), v.end());
+    }
+    std::sort(all.begin(), all.end());
+    if(all.empty()) {
+        return;
+    }
+    ORANGE_LOG_INFO(g_logger) << load
+        << " clients=" << clients
+        << " spin_us=" << spin_us
+        << " busy_poll_us=" << busy_poll_us
+        << " requests=" << all.size()
+        << " req/s=" << (uint64_t)(all.size() * 1000000.0 / used)
+        << " p50=" << all[all.size() / 2] << "us"
+        << " p99=" << all[all.size() * 99 / 100] << "us"
+        << " worker_cpu=" << cpu * 100 / used << "%";
+
+    iom.schedule([sock]() {
+        sock->cancelAll();
+        sock->close();
+    });
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    // {spin_us, busy_poll_us}
+    std::vector<std::pair<uint32_t, uint32_t>> modes = {
+        {0, 0}, {50, 0}, {200, 0}, {50, 50}
+    };
+    for(auto& m : modes) {
+        // 低负载：单连接，请求之间间隔100us，工作线程大部分时间空闲
+        bench("low", 1, 3000, 100, m.first, m.second);
+    }
+    for(auto& m : modes) {
+        // 高负载：多连接背靠背请求
+        bench("high", 4, 5000, 0, m.first, m.second);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "src/orange.h"
+#include "src/fd_manager.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const int s_requests = 20000;
+static std::atomic<int> s_done = {0};
+
+// /proc/self/io 里的read/write类系统调用次数，整个进程累计
+static void read_io_count(uint64_t& syscr, uint64_t& syscw) {
+    syscr = syscw = 0;
+    FILE* fp = fopen("/proc/self/io", "r");
+    if(!fp) {
+        return;
+    }
+    char name[64];
+    unsigned long long value;
+    while(fscanf(fp, "%63s %llu", name, &value) == 2) {
+        if(strcmp(name, "syscr:") == 0) {
+            syscr = value;
+        } else if(strcmp(name, "syscw:") == 0) {
+            syscw = value;
+        }
+    }
+    fclose(fp);
+}
+
+// 一问一答，每次read都会先EAGAIN再挂起
+void client(int fd) {
+    char c = 'c';
+    for(int i = 0; i < s_requests; ++i) {
+        if(write(fd, &c, 1) != 1 || read(fd, &c, 1) != 1) {
+            ORANGE_LOG_ERROR(g_logger) << "client io error errno=" << errno;
+            break;
+        }
+    }
+    close(fd);
+    ++s_done;
+}
+
+void server(int fd) {
+    char c;
+    while(read(fd, &c, 1) == 1) {
+        if(write(fd, &c, 1) != 1) {
+            break;
+        }
+    }
+    close(fd);
+    ++s_done;
+}
+
+void bench(bool register_once) {
+    orange::Config::Lookup<bool>("iomanager.register_once")->setValue(register_once);
+    s_done = 0;
+    orange::IOManager iom(1, false, "syscalls");
+
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+        ORANGE_LOG_ERROR(g_logger) << "socketpair errno=" << errno;
+        return;
+    }
+    // socketpair没有hook，手动登记为socket
+    orange::FdMrg::GetInstance()->get(fds[0], true);
+    orange::FdMrg::GetInstance()->get(fds[1], true);
+
+    uint64_t syscr, syscw;
+    read_io_count(syscr, syscw);
+    uint64_t ctl = iom.getEpollCtlCount();
+    uint64_t wait = iom.getEpollWaitCount();
+    uint64_t begin = orange::GetCurrentUS();
+
+    int sfd = fds[1];
+    int cfd = fds[0];
+    iom.schedule([sfd]() { server(sfd); });
+    iom.schedule([cfd]() { client(cfd); });
+    while(s_done < 2) {
+        usleep(1000);
+    }
+
+    uint64_t used = orange::GetCurrentUS() - begin;
+    uint64_t syscr2, syscw2;
+    read_io_count(syscr2, syscw2);
+    ctl = iom.getEpollCtlCount() - ctl;
+    wait = iom.getEpollWaitCount() - wait;
+    uint64_t rw = (syscr2 - syscr) + (syscw2 - syscw);
+    ORANGE_LOG_INFO(g_logger) << "register_once=" << register_once
+        << " requests=" << s_requests
+        << " read+write/req=" << (double)rw / s_requests
+        << " epoll_ctl/req=" << (double)ctl / s_requests
+        << " epoll_wait/req=" << (double)wait / s_requests
+        << " total/req=" << (double)(rw + ctl + wait) / s_requests
+        << " us/req=" << (double)used / s_requests;
+}
+
+int main(int argc, char** argv) {
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    bench(false);
+    bench(true);
+    return 0;
+}
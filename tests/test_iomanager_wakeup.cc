@@ -0,0 +1,65 @@
+#include "src/orange.h"
+
+#include <unistd.h>
+
+#include <atomic>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static std::atomic<int> s_done = {0};
+
+void task() {
+    ++s_done;
+}
+
+// 逐个提交，每次提交时工作线程基本都处于空闲
+void bench_single(size_t threads, int count) {
+    s_done = 0;
+    orange::IOManager iom(threads, false, "wakeup");
+    uint64_t wakeups = iom.getWakeupCount();
+    uint64_t tasks = iom.getTaskCount();
+    for(int i = 0; i < count; ++i) {
+        iom.schedule(&task);
+        usleep(200);
+    }
+    while(s_done < count) {
+        usleep(1000);
+    }
+    wakeups = iom.getWakeupCount() - wakeups;
+    tasks = iom.getTaskCount() - tasks;
+    ORANGE_LOG_INFO(g_logger) << "single threads=" << threads
+        << " tasks=" << tasks << " wakeups=" << wakeups
+        << " wakeups/task=" << (double)wakeups / tasks;
+}
+
+// 一次提交一批，唤醒次数不超过空闲线程数
+void bench_batch(size_t threads, int rounds, int batch_size) {
+    s_done = 0;
+    orange::IOManager iom(threads, false, "wakeup");
+    uint64_t wakeups = iom.getWakeupCount();
+    uint64_t tasks = iom.getTaskCount();
+    std::vector<std::function<void()>> cbs;
+    for(int i = 0; i < rounds; ++i) {
+        cbs.assign(batch_size, &task);
+        iom.schedule(cbs.begin(), cbs.end());
+        usleep(1000);
+    }
+    while(s_done < rounds * batch_size) {
+        usleep(1000);
+    }
+    wakeups = iom.getWakeupCount() - wakeups;
+    tasks = iom.getTaskCount() - tasks;
+    ORANGE_LOG_INFO(g_logger) << "batch threads=" << threads
+        << " batch=" << batch_size
+        << " tasks=" << tasks << " wakeups=" << wakeups
+        << " wakeups/task=" << (double)wakeups / tasks;
+}
+
+int main(int argc, char** argv) {
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    for(size_t threads : {1, 4, 16}) {
+        bench_single(threads, 2000);
+        bench_batch(threads, 500, 8);
+    }
+    return 0;
+}
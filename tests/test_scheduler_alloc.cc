@@ -0,0 +1,110 @@
+#include "src/orange.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <new>
+
+// 统计堆分配次数
+static std::atomic<uint64_t> s_allocs = {0};
+static thread_local uint64_t t_allocs = 0;
+
+void* operator new(size_t size) {
+    ++s_allocs;
+    ++t_allocs;
+    void* p = malloc(size);
+    if(!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const int s_count = 100000;
+static std::atomic<int> s_done = {0};
+static std::atomic<int> s_remain = {0};
+
+void wait_done(int n) {
+    while(s_done < n) {
+        usleep(1000);
+    }
+}
+
+// 外部线程提交：lambda、std::function两种方式
+// 提交速度超过执行速度时在途任务数会创新高，对象池会扩容，这部分分配会计入结果
+void bench_submit(orange::Scheduler& sc) {
+    s_done = 0;
+    uint64_t before = t_allocs;
+    uint64_t begin = orange::GetCurrentUS();
+    for(int i = 0; i < s_count; ++i) {
+        int* p = nullptr;
+        sc.schedule([p, i]() { ++s_done; (void)p; (void)i; });
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    uint64_t allocs = t_allocs - before;
+    wait_done(s_count);
+    ORANGE_LOG_INFO(g_logger) << "submit lambda: schedules=" << s_count
+        << " allocs/schedule=" << (double)allocs / s_count
+        << " ns/schedule=" << used * 1000 / s_count;
+
+    s_done = 0;
+    std::function<void()> cb = []() { ++s_done; };
+    before = t_allocs;
+    begin = orange::GetCurrentUS();
+    for(int i = 0; i < s_count; ++i) {
+        std::function<void()> tmp = cb;
+        sc.schedule(&tmp);
+    }
+    used = orange::GetCurrentUS() - begin;
+    allocs = t_allocs - before;
+    wait_done(s_count);
+    ORANGE_LOG_INFO(g_logger) << "submit std::function*: schedules=" << s_count
+        << " allocs/schedule=" << (double)allocs / s_count
+        << " ns/schedule=" << used * 1000 / s_count;
+}
+
+void chain_task() {
+    if(--s_remain > 0) {
+        orange::Scheduler::GetThis()->schedule(&chain_task);
+    } else {
+        s_done = 1;
+    }
+}
+
+// 工作线程内提交，计入执行侧的所有分配
+void bench_chain(orange::Scheduler& sc) {
+    s_done = 0;
+    s_remain = s_count;
+    uint64_t before = s_allocs;
+    uint64_t begin = orange::GetCurrentUS();
+    sc.schedule(&chain_task);
+    wait_done(1);
+    uint64_t used = orange::GetCurrentUS() - begin;
+    uint64_t allocs = s_allocs - before;
+    ORANGE_LOG_INFO(g_logger) << "worker chain: schedules=" << s_count
+        << " allocs/schedule=" << (double)allocs / s_count
+        << " ns/task=" << used * 1000 / s_count;
+}
+
+int main(int argc, char** argv) {
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    orange::Scheduler sc(1, false, "alloc");
+    sc.start();
+    // 第一轮预热对象池，看第二轮结果
+    for(int i = 0; i < 2; ++i) {
+        bench_submit(sc);
+        bench_chain(sc);
+    }
+    sc.stop();
+    return 0;
+}
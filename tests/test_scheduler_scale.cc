@@ -0,0 +1,63 @@
+#include "src/orange.h"
+
+#include <atomic>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const int s_total = 200000;
+static std::atomic<int> s_remain = {0};
+
+// 每个任务执行完把下一个任务提交到当前调度器，形成多条任务链
+void chain_task() {
+    if(--s_remain > 0) {
+        orange::Scheduler::GetThis()->schedule(&chain_task);
+    }
+}
+
+// 绑定到当前线程的任务链，走线程自己的inbox
+void pinned_chain_task() {
+    if(--s_remain > 0) {
+        orange::Scheduler::GetThis()->schedule(&pinned_chain_task
+                , orange::GetThreadId());
+    }
+}
+
+void bench(size_t threads) {
+    s_remain = s_total;
+    orange::Scheduler sc(threads, false, "bench");
+    sc.start();
+    uint64_t begin = orange::GetCurrentUS();
+    for(size_t i = 0; i < threads * 4; ++i) {
+        if(i % 2) {
+            sc.schedule(&pinned_chain_task);
+        } else {
+            sc.schedule(&chain_task);
+        }
+    }
+    sc.stop();
+    uint64_t used = orange::GetCurrentUS() - begin;
+    orange::Scheduler::PinnedStat stat = sc.getPinnedStat();
+    ORANGE_LOG_INFO(g_logger) << "threads=" << threads
+        << " tasks=" << s_total
+        << " used=" << used / 1000 << "ms"
+        << " tasks/sec=" << (uint64_t)(s_total * 1000000.0 / used)
+        << " pinned=" << stat.count
+        << " pinned_avg_wait=" << (stat.count ? stat.totalWaitUs / stat.count : 0) << "us"
+        << " pinned_max_wait=" << stat.maxWaitUs << "us";
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    std::vector<size_t> threads = {1, 4, 16, 32};
+    if(argc > 1) {
+        threads.clear();
+        for(int i = 1; i < argc; ++i) {
+            threads.push_back(atoi(argv[i]));
+        }
+    }
+    for(auto n : threads) {
+        bench(n);
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include "src/orange.h"
+#include "src/socket.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+/*
+* 从协程里把大文件发给本机TCP客户端，比较read+write、sendfile、splice的吞吐
+* 以及服务端工作线程消耗的CPU
+* usage: test_sendfile [文件大小MB]
+*/
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const char* s_path = "/tmp/orange_sendfile.dat";
+static const char* s_modes[] = {"read+write", "sendfile  ", "splice    "};
+static size_t s_size = 0;
+static std::atomic<uint64_t> s_cpu_us = {0};
+
+static uint64_t thread_cpu_us() {
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec * 1000000ull + usage.ru_utime.tv_usec
+        + usage.ru_stime.tv_sec * 1000000ull + usage.ru_stime.tv_usec;
+}
+
+bool create_file(size_t size) {
+    int fd = open(s_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if(fd < 0) {
+        return false;
+    }
+    std::string buf(1024 * 1024, 'f');
+    for(size_t i = 0; i < size; i += buf.size()) {
+        if(write(fd, &buf[0], buf.size()) != (ssize_t)buf.size()) {
+            close(fd);
+            return false;
+        }
+    }
+    close(fd);
+    return true;
+}
+
+bool send_read_write(orange::Socket::ptr sock, int fd) {
+    char buf[64 * 1024];
+    while(true) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if(n <= 0) {
+            return n == 0;
+        }
+        for(ssize_t sent = 0; sent < n;) {
+            int rt = sock->send(buf + sent, n - sent);
+            if(rt <= 0) {
+                return false;
+            }
+            sent += rt;
+        }
+    }
+}
+
+bool send_splice(orange::Socket::ptr sock, int fd) {
+    int pipes[2];
+    if(pipe(pipes)) {
+        return false;
+    }
+    loff_t offset = 0;
+    bool ok = true;
+    while(ok && offset < (loff_t)s_size) {
+        ssize_t n = splice(fd, &offset, pipes[1], nullptr, 64 * 1024, SPLICE_F_MOVE);
+        if(n <= 0) {
+            ok = false;
+            break;
+        }
+        while(n > 0) {
+            ssize_t rt = splice(pipes[0], nullptr, sock->getSocket(), nullptr, n, SPLICE_F_MOVE);
+            if(rt <= 0) {
+                ok = false;
+                break;
+            }
+            n -= rt;
+        }
+    }
+    close(pipes[0]);
+    close(pipes[1]);
+    return ok;
+}
+
+void serve(orange::Socket::ptr client) {
+    char mode = 0;
+    if(client->recv(&mode, 1) != 1) {
+        return;
+    }
+    int fd = open(s_path, O_RDONLY);
+    uint64_t cpu = thread_cpu_us();
+    bool ok = false;
+    if(mode == 0) {
+        ok = send_read_write(client, fd);
+    } else if(mode == 1) {
+        ok = client->sendFile(fd, 0, s_size) == (int64_t)s_size;
+    } else {
+        ok = send_splice(client, fd);
+    }
+    s_cpu_us = thread_cpu_us() - cpu;
+    if(!ok) {
+        ORANGE_LOG_ERROR(g_logger) << s_modes[(int)mode] << " failed errno=" << errno;
+    }
+    close(fd);
+    client->close();
+}
+
+void server(orange::Socket::ptr sock) {
+    while(true) {
+        orange::Socket::ptr client = sock->accept();
+        if(!client) {
+            break;
+        }
+        serve(client);
+    }
+}
+
+// 客户端线程不hook，阻塞读到对端关闭
+void bench(int port, char mode) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (sockaddr*)&addr, sizeof(addr)) || write(fd, &mode, 1) != 1) {
+        ORANGE_LOG_ERROR(g_logger) << "connect errno=" << errno;
+        close(fd);
+        return;
+    }
+    uint64_t begin = orange::GetCurrentUS();
+    char buf[256 * 1024];
+    size_t total = 0;
+    ssize_t n = 0;
+    while((n = read(fd, buf, sizeof(buf))) > 0) {
+        total += n;
+    }
+    uint64_t used = orange::GetCurrentUS() - begin;
+    close(fd);
+
+    ORANGE_LOG_INFO(g_logger) << s_modes[(int)mode]
+        << " bytes=" << total
+        << " MB/s=" << (uint64_t)(total / 1024.0 / 1024.0 * 1000000.0 / used)
+        << " server_cpu=" << s_cpu_us / 1000 << "ms";
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    s_size = (argc > 1 ? atoi(argv[1]) : 64) * 1024 * 1024;
+    if(!create_file(s_size)) {
+        ORANGE_LOG_ERROR(g_logger) << "create " << s_path << " failed";
+        return 1;
+    }
+
+    orange::IOManager iom(1, false, "sendfile");
+    orange::Address::ptr addr = orange::Address::LookupAny("127.0.0.1:8035");
+    orange::Socket::ptr sock = orange::Socket::CreateTCP(addr);
+    std::atomic<int> ready = {-1};
+    iom.schedule([sock, addr, &ready]() {
+        ready = sock->bind(addr) && sock->listen() ? 1 : 0;
+    });
+    while(ready == -1) {
+        usleep(1000);
+    }
+    if(!ready) {
+        ORANGE_LOG_ERROR(g_logger) << "listen " << addr->toString() << " failed";
+        return 1;
+    }
+    iom.schedule(std::bind(&server, sock));
+
+    for(int i = 0; i < 2; ++i) {
+        for(char mode = 0; mode < 3; ++mode) {
+            bench(8035, mode);
+        }
+    }
+    iom.schedule([sock]() { sock->cancelAccept(); sock->close(); });
+    unlink(s_path);
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "src/orange.h"
+#include "src/address.h"
+#include "src/socket.h"
+
+#include <errno.h>
+#include <sys/time.h>
+
+/*
+* Socket::setSendTimeout/setRecvTimeout：每个setter只设置自己的选项，
+* 毫秒正确换算成timeval，hook下FdCtx记录的超时和实际recv超时都要对得上
+*/
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static int s_failed = 0;
+
+#define CHECK(cond) \
+    if(!(cond)) { \
+        ++s_failed; \
+        ORANGE_LOG_ERROR(g_logger) << "check fail: " #cond; \
+    }
+
+// 取值都是10ms的整数倍，内核按jiffies保存，HZ=100时读回来也不变
+static const int64_t s_send_ms = 1500;
+static const int64_t s_recv_ms = 2200;
+
+static int64_t option_ms(orange::Socket::ptr sock, int option) {
+    struct timeval tv{-1, -1};
+    if(!sock->getOption(SOL_SOCKET, option, tv)) {
+        return -1;
+    }
+    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static bool option_is(orange::Socket::ptr sock, int option, time_t sec, suseconds_t usec) {
+    struct timeval tv{-1, -1};
+    return sock->getOption(SOL_SOCKET, option, tv)
+        && tv.tv_sec == sec && tv.tv_usec == usec;
+}
+
+// fd在bind或connect时才创建
+static orange::Socket::ptr bound_tcp() {
+    orange::Socket::ptr sock = orange::Socket::CreateTCPSocket();
+    CHECK(sock->bind(orange::IPv4Address::Create("127.0.0.1", 0)));
+    return sock;
+}
+
+// 内核里的选项值
+void test_options(const char* name) {
+    orange::Socket::ptr sock = bound_tcp();
+    CHECK(option_ms(sock, SO_SNDTIMEO) == 0);
+    CHECK(option_ms(sock, SO_RCVTIMEO) == 0);
+
+    sock->setSendTimeout(s_send_ms);
+    CHECK(option_is(sock, SO_SNDTIMEO, 1, 500000));
+    CHECK(option_ms(sock, SO_RCVTIMEO) == 0);
+
+    sock->setRecvTimeout(s_recv_ms);
+    CHECK(option_is(sock, SO_RCVTIMEO, 2, 200000));
+    CHECK(option_is(sock, SO_SNDTIMEO, 1, 500000));
+
+    // 不足1秒的部分
+    sock->setRecvTimeout(20);
+    CHECK(option_is(sock, SO_RCVTIMEO, 0, 20000));
+    CHECK(option_ms(sock, SO_SNDTIMEO) == s_send_ms);
+
+    // 0表示不超时
+    sock->setSendTimeout(0);
+    CHECK(option_ms(sock, SO_SNDTIMEO) == 0);
+    CHECK(option_ms(sock, SO_RCVTIMEO) == 20);
+    ORANGE_LOG_INFO(g_logger) << name << " options ok";
+}
+
+// hook下getter读的是FdCtx记录的值，recv按它超时
+void test_hooked() {
+    test_options("hooked");
+
+    orange::Socket::ptr sock = bound_tcp();
+    sock->setSendTimeout(s_send_ms);
+    CHECK(sock->getSendTimeout() == s_send_ms);
+    CHECK(sock->getRecvTimeout() == -1);
+    sock->setRecvTimeout(s_recv_ms);
+    CHECK(sock->getRecvTimeout() == s_recv_ms);
+    CHECK(sock->getSendTimeout() == s_send_ms);
+
+    // 连到一个不回包的UDP端口上，recv只能等到超时
+    orange::Socket::ptr silent = orange::Socket::CreateUDPSocket();
+    CHECK(silent->bind(orange::IPv4Address::Create("127.0.0.1", 0)));
+    orange::Socket::ptr udp = orange::Socket::CreateUDPSocket();
+    CHECK(udp->connect(silent->getLocalAddress()));
+    udp->setRecvTimeout(300);
+    char buf[16];
+    uint64_t begin = orange::GetCurrentMS();
+    int rt = udp->recv(buf, sizeof(buf));
+    uint64_t used = orange::GetCurrentMS() - begin;
+    CHECK(rt == -1 && errno == ETIMEDOUT);
+    CHECK(used >= 290 && used < 1000);
+    ORANGE_LOG_INFO(g_logger) << "hooked recv timeout ok: used=" << used << "ms";
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::FATAL);
+
+    test_options("plain");
+    {
+        orange::IOManager iom(1, false, "timeout");
+        iom.schedule(&test_hooked);
+    }
+
+    ORANGE_LOG_INFO(g_logger) << (s_failed ? "FAILED" : "ALL OK") << " failed=" << s_failed;
+    return s_failed ? 1 : 0;
+}
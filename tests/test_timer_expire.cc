@@ -0,0 +1,104 @@
+#include "src/orange.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static std::atomic<uint64_t> s_fired = {0};
+
+class BenchTimerManager : public orange::TimerManager {
+protected:
+    void onTimerInsertAtFront() override {}
+};
+
+// 到期后直接执行，只统计取出定时器本身的开销
+class RunSink : public orange::TimerManager::ExpiredSink {
+public:
+    void add(std::function<void()>& cb) override {
+        cb();
+    }
+};
+
+// 回调捕获连接对象，和超时关闭连接类似
+void add_timers(orange::TimerManager& mgr, size_t count, uint64_t ms) {
+    std::shared_ptr<int> conn(new int(0));
+    for(size_t i = 0; i < count; ++i) {
+        mgr.addTimer(ms, [conn, i]() { s_fired += i & 1; });
+    }
+}
+
+uint64_t list_once(size_t count, bool sink) {
+    BenchTimerManager mgr;
+    add_timers(mgr, count, 1);
+    usleep(2000);
+    uint64_t begin = orange::GetCurrentUS();
+    if(sink) {
+        RunSink run;
+        mgr.listExpired(run);
+    } else {
+        std::vector<std::function<void()>> cbs;
+        mgr.listExpiredCb(cbs);
+        for(auto& cb : cbs) {
+            cb();
+        }
+    }
+    return orange::GetCurrentUS() - begin;
+}
+
+void bench_list(size_t count, bool wheel) {
+    orange::Config::Lookup<bool>("timer.wheel")->setValue(wheel);
+    // 各跑5次取最小值，减少抖动
+    uint64_t vector_us = ~0ull;
+    uint64_t sink_us = ~0ull;
+    for(int i = 0; i < 5; ++i) {
+        vector_us = std::min(vector_us, list_once(count, false));
+        sink_us = std::min(sink_us, list_once(count, true));
+    }
+    ORANGE_LOG_INFO(g_logger) << (wheel ? "wheel" : "set  ")
+        << " expired=" << count
+        << " vector=" << vector_us * 1000 / count << "ns/timer"
+        << " sink=" << sink_us * 1000 / count << "ns/timer";
+}
+
+// 大量连接同时超时：从到期到所有回调执行完的时间，以及单轮循环的最长耗时
+void bench_iomanager(size_t count) {
+    s_fired = 0;
+    orange::IOManager iom(2, false, "expire");
+    uint64_t fire_at = orange::GetCurrentMS() + 200;
+    for(size_t i = 0; i < count; ++i) {
+        iom.addTimer(200, []() { ++s_fired; });
+    }
+    while(s_fired < count) {
+        usleep(1000);
+    }
+    uint64_t used = orange::GetCurrentMS() - fire_at;
+    ORANGE_LOG_INFO(g_logger) << "iomanager expired=" << count
+        << " all_done_after=" << used << "ms"
+        << " max_loop<" << iom.getLoopTime().percentile(1) << "us";
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    std::vector<size_t> counts = {10000, 100000};
+    if(argc > 1) {
+        counts.clear();
+        for(int i = 1; i < argc; ++i) {
+            counts.push_back(atoi(argv[i]));
+        }
+    }
+    for(auto n : counts) {
+        bench_list(n, false);
+        bench_list(n, true);
+    }
+    for(auto n : counts) {
+        bench_iomanager(n);
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "src/orange.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <vector>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+static const int s_ops = 200000;
+static std::atomic<int> s_done = {0};
+
+// 每次IO加一个超时、完成后取消；yield时取消可能发生在其他线程
+void churn(orange::IOManager* iom, int ops, bool yield) {
+    for(int i = 0; i < ops; ++i) {
+        orange::Timer::ptr timer = iom->addTimer(10000, []() {});
+        if(yield) {
+            orange::Fiber::YielToReady();
+        }
+        timer->cancel();
+    }
+    ++s_done;
+}
+
+void bench(size_t threads, bool per_thread, bool yield) {
+    orange::Config::Lookup<bool>("timer.per_thread")->setValue(per_thread);
+    s_done = 0;
+    // 每个线程4个任务，总操作数不随线程数变化
+    int tasks = threads * 4;
+    int ops = s_ops / tasks;
+    uint64_t begin = 0;
+    uint64_t used = 0;
+    {
+        orange::IOManager iom(threads, false, "timer");
+        begin = orange::GetCurrentUS();
+        for(int i = 0; i < tasks; ++i) {
+            iom.schedule(std::bind(churn, &iom, ops, yield));
+        }
+        while(s_done < tasks) {
+            usleep(100);
+        }
+        used = orange::GetCurrentUS() - begin;
+    }
+    ORANGE_LOG_INFO(g_logger) << (per_thread ? "per_thread" : "shared    ")
+        << (yield ? " yield" : "      ")
+        << " threads=" << threads
+        << " ops=" << ops * tasks
+        << " used=" << used / 1000 << "ms"
+        << " ops/sec=" << (uint64_t)(ops * tasks * 1000000.0 / used);
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    ORANGE_LOG_NAME("system")->setLevel(orange::LogLevel::ERROR);
+    std::vector<size_t> threads = {1, 2, 4, 8};
+    if(argc > 1) {
+        threads.clear();
+        for(int i = 1; i < argc; ++i) {
+            threads.push_back(atoi(argv[i]));
+        }
+    }
+    for(bool yield : {false, true}) {
+        for(auto n : threads) {
+            bench(n, false, yield);
+            bench(n, true, yield);
+        }
+    }
+    return 0;
+}
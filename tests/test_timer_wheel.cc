@@ -0,0 +1,66 @@
+#include "src/orange.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+orange::Logger::ptr g_logger = ORANGE_LOG_ROOT();
+
+class BenchTimerManager : public orange::TimerManager {
+protected:
+    void onTimerInsertAtFront() override {}
+};
+
+void bench(size_t count, bool wheel) {
+    orange::Config::Lookup<bool>("timer.wheel")->setValue(wheel);
+    BenchTimerManager mgr;
+    std::mt19937 rng(count);
+    std::vector<orange::Timer::ptr> timers;
+    timers.reserve(count);
+
+    // 1s~60s的超时，测试期间都不会到期，和连接上的读写超时类似
+    uint64_t begin = orange::GetCurrentUS();
+    for(size_t i = 0; i < count; ++i) {
+        timers.push_back(mgr.addTimer(1000 + rng() % 59000, []() {}));
+    }
+    uint64_t add_us = orange::GetCurrentUS() - begin;
+
+    // 常驻count个定时器时，每次IO加一个超时、完成后取消
+    begin = orange::GetCurrentUS();
+    for(size_t i = 0; i < count; ++i) {
+        orange::Timer::ptr timer = mgr.addTimer(1000 + rng() % 59000, []() {});
+        timer->cancel();
+    }
+    uint64_t churn_us = orange::GetCurrentUS() - begin;
+
+    std::shuffle(timers.begin(), timers.end(), rng);
+    begin = orange::GetCurrentUS();
+    for(auto& timer : timers) {
+        timer->cancel();
+    }
+    uint64_t cancel_us = orange::GetCurrentUS() - begin;
+
+    ORANGE_LOG_INFO(g_logger) << (wheel ? "wheel" : "set  ")
+        << " timers=" << count
+        << " add=" << add_us * 1000 / count << "ns/op"
+        << " add+cancel=" << churn_us * 1000 / count << "ns/op"
+        << " cancel=" << cancel_us * 1000 / count << "ns/op";
+}
+
+int main(int argc, char** argv) {
+    g_logger->setLevel(orange::LogLevel::INFO);
+    std::vector<size_t> counts = {10000, 100000, 1000000};
+    if(argc > 1) {
+        counts.clear();
+        for(int i = 1; i < argc; ++i) {
+            counts.push_back(atoi(argv[i]));
+        }
+    }
+    for(auto n : counts) {
+        bench(n, false);
+        bench(n, true);
+    }
+    return 0;
+}